@@ -9,6 +9,9 @@
 #include <perspcameracomponent.h>
 #include <audio/component/playbackcomponent.h>
 
+// Std includes
+#include <cfloat>
+
 
 RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::VBANDemoApp)
 	RTTI_CONSTRUCTOR(nap::Core&)
@@ -107,7 +110,69 @@ namespace nap
                              mReceiverTickIdx, nullptr, 0.0f, 0.2f,
                              ImVec2(ImGui::GetColumnWidth(), 128)); // Plot the output values
 
+        ImGui::Spacing();
+        if (ImGui::CollapsingHeader("Statistics"))
+        {
+            // packets seen by the receiver
+            vban_stream_player_component->mVBANPacketReceiver->getStatistics(mReceiverStatistics);
+            ImGui::Text("Packets received: %llu", static_cast<unsigned long long>(mReceiverStatistics.mPackets));
+            for (int i = 1; i < static_cast<int>(EVBANPacketError::Count); i++)
+            {
+                auto const count = mReceiverStatistics.mRejects[i];
+                if (count > 0)
+                    ImGui::Text("Rejected (%s): %llu", utility::toString(static_cast<EVBANPacketError>(i)), static_cast<unsigned long long>(count));
+            }
+            for (const auto& stream : mReceiverStatistics.mStreams)
+            {
+                ImGui::Text("Stream '%s': %llu packets, %llu samples", stream.mStreamName.c_str(),
+                            static_cast<unsigned long long>(stream.mPackets), static_cast<unsigned long long>(stream.mFrames));
+            }
 
+            // playout of the stream
+            vban_stream_player_instance.getStatistics(mPlayoutStatistics);
+            ImGui::Text("Packets played: %llu", static_cast<unsigned long long>(mPlayoutStatistics.mPacketsReleased));
+            ImGui::Text("Lost: %llu  Reordered: %llu  Duplicate: %llu  Late: %llu  Resyncs: %llu",
+                        static_cast<unsigned long long>(mPlayoutStatistics.mPacketsLost),
+                        static_cast<unsigned long long>(mPlayoutStatistics.mPacketsReordered),
+                        static_cast<unsigned long long>(mPlayoutStatistics.mPacketsDuplicate),
+                        static_cast<unsigned long long>(mPlayoutStatistics.mPacketsLate),
+                        static_cast<unsigned long long>(mPlayoutStatistics.mResyncs));
+            ImGui::Text("Underruns: %llu  Dropped samples: %llu  Concealed samples: %llu",
+                        static_cast<unsigned long long>(mPlayoutStatistics.mUnderruns),
+                        static_cast<unsigned long long>(mPlayoutStatistics.mDroppedSamples),
+                        static_cast<unsigned long long>(mPlayoutStatistics.mConcealedSamples));
+            ImGui::Text("Latency: %.1f ms", mPlayoutStatistics.mLatency);
+
+            // distribution of the queue fill, bin n holds the audio blocks with [2^(n-1), 2^n) queued samples
+            mPlotQueueFillValues.resize(VBANHistogram::sBinCount);
+            for (int i = 0; i < VBANHistogram::sBinCount; i++)
+                mPlotQueueFillValues[i] = static_cast<float>(mPlayoutStatistics.mQueueFill[i]);
+            int const last_bin = VBANHistogram::sBinCount - 1;
+            ImGui::Text("Queued samples (0 to %u+, %.1f ms)", VBANHistogram::getBinStart(last_bin),
+                        mPlayoutStatistics.mSampleRate > 0 ? 1000.0f * VBANHistogram::getBinStart(last_bin) / mPlayoutStatistics.mSampleRate : 0.0f);
+            ImGui::PlotHistogram("##QueueFill",
+                                 mPlotQueueFillValues.data(),
+                                 mPlotQueueFillValues.size(),
+                                 0, nullptr, 0.0f, FLT_MAX,
+                                 ImVec2(ImGui::GetColumnWidth(), 96));
+
+            // end to end latency, measured because sender and player of the stream share a monitor
+            if (vban_stream_player_component->mLatencyMonitor != nullptr)
+            {
+                vban_stream_player_component->mLatencyMonitor->getReport(mLatencyReport);
+                ImGui::Text("End to end latency over %i packets (ms)", mLatencyReport.mFrameCount);
+                auto show_stage = [](const char* name, const VBANLatencyReport::Stage& stage)
+                {
+                    ImGui::Text("%-14s min %6.2f  mean %6.2f  median %6.2f  p95 %6.2f  max %6.2f",
+                                name, stage.mMin, stage.mMean, stage.mMedian, stage.mP95, stage.mMax);
+                };
+                show_stage("Packetization", mLatencyReport.mPacketization);
+                show_stage("Network", mLatencyReport.mNetwork);
+                show_stage("Queueing", mLatencyReport.mQueueing);
+                show_stage("Playout", mLatencyReport.mPlayout);
+                show_stage("Total", mLatencyReport.mTotal);
+            }
+        }
 
         ImGui::PopID();
         ImGui::End();
@@ -123,14 +188,25 @@ namespace nap
 
         ImGui::Text("Sending for VBAN packets to :");
         ImGui::SameLine();
-        ImGui::TextColored(pallete.mHighlightColor3, "%s:%i",
-                           vban_stream_sender_component->mUdpClient->mEndpoint.c_str(),
-                           vban_stream_sender_component->mUdpClient->mPort);
+        for (const auto& endpoint : vban_stream_sender_component->mEndpoints)
+        {
+            if (endpoint.find(':') != std::string::npos)
+                ImGui::TextColored(pallete.mHighlightColor3, "%s", endpoint.c_str());
+            else
+                ImGui::TextColored(pallete.mHighlightColor3, "%s:%i", endpoint.c_str(), vban_stream_sender_component->mPort);
+        }
 
         ImGui::Text("Sending to stream:");
         ImGui::SameLine();
         ImGui::TextColored(pallete.mHighlightColor3, "%s", vban_stream_sender_component->mStreamName.c_str());
 
+        vban_stream_sender_component_instance.getStatistics(mSenderStatistics);
+        ImGui::Text("Packets queued: %llu  Sent: %llu  Dropped: %llu  Suppressed: %llu",
+                    static_cast<unsigned long long>(mSenderStatistics.mPacketsQueued),
+                    static_cast<unsigned long long>(mSenderStatistics.mPacketsSent),
+                    static_cast<unsigned long long>(mSenderStatistics.mPacketsDropped),
+                    static_cast<unsigned long long>(mSenderStatistics.mPacketsSuppressed));
+
         bool play = playback_component_instance.isPlaying();
         if(ImGui::Checkbox("Play", &play))
         {
@@ -92,5 +92,12 @@ namespace nap
         std::vector<audio::ControllerValue> mPlotSenderValues = { };
         uint32 mSenderTickIdx = 0;
 
+        // receive and playout statistics of the VBAN stream
+        VBANReceiverStatistics mReceiverStatistics;
+        VBANPlayoutStatistics mPlayoutStatistics;
+        VBANSenderStatistics mSenderStatistics;
+        VBANLatencyReport mLatencyReport;
+        std::vector<float> mPlotQueueFillValues = { };
+
     };
 }
@@ -0,0 +1,62 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "clockdriftcontroller.h"
+
+// Std includes
+#include <algorithm>
+#include <cmath>
+
+namespace nap
+{
+	namespace audio
+	{
+        // Time constant of the fill level smoothing, averages out the saw tooth caused by packet arrival
+        static constexpr double sSmoothingTime = 2.0;
+
+        // Controller gains, applied to the fill error in seconds. Gives a damping of ~0.5 and a settling time of a few minutes
+        static constexpr double sProportionalGain = 0.05;
+        static constexpr double sIntegralGain = 0.002;
+
+        // Max deviation of the ratio from 1, far beyond the drift of any sound card
+        static constexpr double sMaxDeviation = 0.001;
+
+
+        ClockDriftController::ClockDriftController(float targetFill, float sampleRate, int bufferSize) :
+            mTargetFill(targetFill), mSampleRate(sampleRate)
+        {
+            mBlockDuration = static_cast<double>(bufferSize) / mSampleRate;
+            mSmoothing = 1.0 - std::exp(-mBlockDuration / sSmoothingTime);
+        }
+
+
+        double ClockDriftController::update(DiscreteTimeValue sampleTime, float queueFill)
+        {
+            // only the first channel to process a block updates the controller
+            if (sampleTime == mLastUpdate)
+                return mRatio;
+            mLastUpdate = sampleTime;
+
+            if (!mPrimed)
+            {
+                mFilteredFill = queueFill;
+                mPrimed = true;
+            }
+            mFilteredFill += (queueFill - mFilteredFill) * mSmoothing;
+
+            // a fuller queue than targeted means the sender runs fast, consume more samples per output sample
+            double const error = (mFilteredFill - mTargetFill) / mSampleRate;
+            mIntegral += error * mBlockDuration;
+            mIntegral = std::clamp(mIntegral, -sMaxDeviation / sIntegralGain, sMaxDeviation / sIntegralGain);
+
+            double const deviation = sProportionalGain * error + sIntegralGain * mIntegral;
+            mRatio = 1.0 + std::clamp(deviation, -sMaxDeviation, sMaxDeviation);
+
+            mRatioValue.store(mRatio, std::memory_order_relaxed);
+            mFilteredFillValue.store(static_cast<float>(mFilteredFill), std::memory_order_relaxed);
+            return mRatio;
+        }
+
+	}
+}
@@ -0,0 +1,77 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Std includes
+#include <atomic>
+#include <limits>
+
+// Audio includes
+#include <audio/utility/audiotypes.h>
+
+namespace nap
+{
+	namespace audio
+	{
+
+        /**
+         * Estimates the clock drift between a remote sender and the local audio device from the fill level of a
+         * playout queue, and computes the resampling ratio that keeps the queue at a target fill.
+         * A smoothed fill level drives a proportional-integral controller, the ratio is limited to +/- 1000 ppm.
+         * One controller is shared by all channels of a stream, so all channels are resampled identically.
+         * Updated on the audio thread, the ratio can be read from any thread.
+         */
+        class NAPAPI ClockDriftController
+        {
+        public:
+            /**
+             * Constructor
+             * @param targetFill the queue fill in samples the controller converges to
+             * @param sampleRate the sample rate of the audio device
+             * @param bufferSize the number of samples processed per update
+             */
+            ClockDriftController(float targetFill, float sampleRate, int bufferSize);
+
+            /**
+             * Updates the ratio once per processed block, subsequent calls for the same block return the same ratio.
+             * @param sampleTime the sample time of the block being processed
+             * @param queueFill the number of samples waiting to be played
+             * @return number of input samples to consume per output sample
+             */
+            double update(DiscreteTimeValue sampleTime, float queueFill);
+
+            /**
+             * @return number of input samples consumed per output sample
+             */
+            double getRatio() const { return mRatioValue.load(std::memory_order_relaxed); }
+
+            /**
+             * @return the smoothed fill level of the queue in samples
+             */
+            float getFilteredFill() const { return mFilteredFillValue.load(std::memory_order_relaxed); }
+
+            /**
+             * @return the fill level the controller converges to
+             */
+            float getTargetFill() const { return mTargetFill; }
+
+        private:
+            float mTargetFill;
+            double mSampleRate;
+            double mBlockDuration;
+            double mSmoothing;
+
+            DiscreteTimeValue mLastUpdate = std::numeric_limits<DiscreteTimeValue>::max();
+            bool mPrimed = false;
+            double mFilteredFill = 0.0;
+            double mIntegral = 0.0;
+            double mRatio = 1.0;
+
+            std::atomic<double> mRatioValue = { 1.0 };
+            std::atomic<float> mFilteredFillValue = { 0.0f };
+        };
+
+	}
+}
@@ -0,0 +1,127 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "multichannelringbuffer.h"
+
+// Std includes
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace nap
+{
+	namespace audio
+	{
+
+        void MultiChannelRingBuffer::init(int channelCount, int capacity)
+        {
+            int size = 1;
+            while (size < capacity)
+                size <<= 1;
+
+            mChannelCount = channelCount;
+            mCapacity = size;
+            mMask = static_cast<uint64_t>(size - 1);
+            mData.assign(static_cast<size_t>(channelCount) * size, 0.0f);
+            mWriteIndex.store(0);
+            mReadIndex.store(0);
+        }
+
+
+        bool MultiChannelRingBuffer::write(const float* data, int channelStride, int frameCount)
+        {
+            uint64_t const write_index = mWriteIndex.load(std::memory_order_relaxed);
+            uint64_t const read_index = mReadIndex.load(std::memory_order_acquire);
+            if (frameCount > mCapacity - static_cast<int>(write_index - read_index))
+                return false;
+
+            // the block wraps at most once
+            int const start = static_cast<int>(write_index & mMask);
+            int const first = std::min(frameCount, mCapacity - start);
+            for (int channel = 0; channel < mChannelCount; channel++)
+            {
+                const float* source = data + static_cast<size_t>(channel) * channelStride;
+                float* ring = getChannel(channel);
+                std::memcpy(ring + start, source, first * sizeof(float));
+                std::memcpy(ring, source + first, (frameCount - first) * sizeof(float));
+            }
+
+            mWriteIndex.store(write_index + frameCount, std::memory_order_release);
+            return true;
+        }
+
+
+        bool MultiChannelRingBuffer::writeSilence(int frameCount)
+        {
+            uint64_t const write_index = mWriteIndex.load(std::memory_order_relaxed);
+            uint64_t const read_index = mReadIndex.load(std::memory_order_acquire);
+            if (frameCount > mCapacity - static_cast<int>(write_index - read_index))
+                return false;
+
+            int const start = static_cast<int>(write_index & mMask);
+            int const first = std::min(frameCount, mCapacity - start);
+            for (int channel = 0; channel < mChannelCount; channel++)
+            {
+                float* ring = getChannel(channel);
+                std::fill(ring + start, ring + start + first, 0.0f);
+                std::fill(ring, ring + (frameCount - first), 0.0f);
+            }
+
+            mWriteIndex.store(write_index + frameCount, std::memory_order_release);
+            return true;
+        }
+
+
+        int MultiChannelRingBuffer::read(float* const* destinations, int frameCount)
+        {
+            uint64_t const read_index = mReadIndex.load(std::memory_order_relaxed);
+            uint64_t const write_index = mWriteIndex.load(std::memory_order_acquire);
+            int const count = std::min(frameCount, static_cast<int>(write_index - read_index));
+            if (count <= 0)
+                return 0;
+
+            int const start = static_cast<int>(read_index & mMask);
+            int const first = std::min(count, mCapacity - start);
+            for (int channel = 0; channel < mChannelCount; channel++)
+            {
+                const float* ring = getChannel(channel);
+                std::memcpy(destinations[channel], ring + start, first * sizeof(float));
+                std::memcpy(destinations[channel] + first, ring, (count - first) * sizeof(float));
+            }
+
+            mReadIndex.store(read_index + count, std::memory_order_release);
+            return count;
+        }
+
+
+        int MultiChannelRingBuffer::copyLatest(float* const* destinations, int frameCount) const
+        {
+            // the consumer never writes, so samples behind the write index stay intact until the producer overwrites them
+            uint64_t const write_index = mWriteIndex.load(std::memory_order_relaxed);
+            int const count = static_cast<int>(std::min<uint64_t>(write_index, static_cast<uint64_t>(std::min(frameCount, mCapacity))));
+            if (count <= 0)
+                return 0;
+
+            int const start = static_cast<int>((write_index - count) & mMask);
+            int const first = std::min(count, mCapacity - start);
+            for (int channel = 0; channel < mChannelCount; channel++)
+            {
+                const float* ring = getChannel(channel);
+                std::memcpy(destinations[channel], ring + start, first * sizeof(float));
+                std::memcpy(destinations[channel] + first, ring, (count - first) * sizeof(float));
+            }
+            return count;
+        }
+
+
+        int MultiChannelRingBuffer::getReadAvailable() const
+        {
+            // load the read index first, so the difference can not become negative
+            uint64_t const read_index = mReadIndex.load(std::memory_order_acquire);
+            uint64_t const write_index = mWriteIndex.load(std::memory_order_acquire);
+            return static_cast<int>(write_index - read_index);
+        }
+
+	}
+}
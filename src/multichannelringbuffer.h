@@ -0,0 +1,114 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Nap includes
+#include <utility/dllexport.h>
+
+// Std includes
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace nap
+{
+	namespace audio
+	{
+
+        /**
+         * Lock free single producer, single consumer ring buffer holding the samples of all channels of a stream.
+         * Every channel is stored as a contiguous ring, a single write index and read index are shared by all channels,
+         * so the channels can never run out of sync. Writing or reading a block costs one atomic store for all channels.
+         * All memory is allocated on init.
+         */
+        class NAPAPI MultiChannelRingBuffer
+        {
+        public:
+            /**
+             * Allocates the ring, not thread safe
+             * @param channelCount number of channels
+             * @param capacity min number of samples per channel the ring can hold, rounded up to a power of two
+             */
+            void init(int channelCount, int capacity);
+
+            /**
+             * Writes a block of planar samples, all or nothing. Producer thread only.
+             * @param data planar input samples, channel c starts at data + c * channelStride
+             * @param channelStride distance between the channels in the input
+             * @param frameCount number of samples per channel
+             * @return false when there is not enough room for the whole block, nothing is written
+             */
+            bool write(const float* data, int channelStride, int frameCount);
+
+            /**
+             * Writes silence to all channels, all or nothing. Producer thread only.
+             * @param frameCount number of samples per channel
+             * @return false when there is not enough room, nothing is written
+             */
+            bool writeSilence(int frameCount);
+
+            /**
+             * Reads samples of all channels into separate destinations. Consumer thread only.
+             * @param destinations one pointer per channel the samples are copied to
+             * @param frameCount max number of samples per channel to read
+             * @return number of samples per channel read
+             */
+            int read(float* const* destinations, int frameCount);
+
+            /**
+             * Copies the most recently written samples of all channels, whether read already or not. Producer thread only.
+             * @param destinations one pointer per channel the samples are copied to, oldest sample first
+             * @param frameCount max number of samples per channel to copy
+             * @return number of samples per channel copied, less than frameCount when less was written since init
+             */
+            int copyLatest(float* const* destinations, int frameCount) const;
+
+            /**
+             * @return number of samples per channel that can be read, exact on the consumer thread
+             */
+            int getReadAvailable() const;
+
+            /**
+             * @return number of samples per channel that can be written, exact on the producer thread
+             */
+            int getWriteAvailable() const { return mCapacity - getReadAvailable(); }
+
+            /**
+             * @return number of samples per channel written since init, the position of the next sample written. Producer thread only.
+             */
+            uint64_t getWritePosition() const { return mWriteIndex.load(std::memory_order_relaxed); }
+
+            /**
+             * @return number of samples per channel read since init, the position of the next sample read. Consumer thread only.
+             */
+            uint64_t getReadPosition() const { return mReadIndex.load(std::memory_order_relaxed); }
+
+            /**
+             * @return number of channels
+             */
+            int getChannelCount() const { return mChannelCount; }
+
+            /**
+             * @return number of samples per channel the ring can hold
+             */
+            int getCapacity() const { return mCapacity; }
+
+        private:
+            float* getChannel(int channel) { return &mData[static_cast<size_t>(channel) * mCapacity]; }
+            const float* getChannel(int channel) const { return &mData[static_cast<size_t>(channel) * mCapacity]; }
+
+            std::vector<float> mData;       // Channel c occupies [c * capacity, (c + 1) * capacity)
+            int mChannelCount = 0;
+            int mCapacity = 0;
+            uint64_t mMask = 0;
+
+            // Indices grow monotonically, on separate cache lines to avoid false sharing between producer and consumer
+            alignas(64) std::atomic<uint64_t> mWriteIndex = { 0 };
+            alignas(64) std::atomic<uint64_t> mReadIndex = { 0 };
+        };
+
+	}
+}
@@ -0,0 +1,198 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "packetlossconcealer.h"
+
+// Std includes
+#include <algorithm>
+#include <cmath>
+
+namespace nap
+{
+	namespace audio
+	{
+        // Pitch periods between 2.5 ms (400 Hz) and 15 ms (66 Hz) are searched, correlated over 5 ms
+        static constexpr float sMinPeriodTime = 0.0025f;
+        static constexpr float sMaxPeriodTime = 0.015f;
+        static constexpr float sMatchTime = 0.005f;
+
+        // The repetition plays at full level for 10 ms and fades to silence in the following 50 ms
+        static constexpr float sFadeStartTime = 0.01f;
+        static constexpr float sFadeTime = 0.05f;
+
+        // Audio following a loss is crossfaded in over 2.5 ms
+        static constexpr float sRecoveryTime = 0.0025f;
+
+        // Max number of samples per channel synthesized per call
+        static constexpr int sOutputSize = 256;
+
+
+        void PacketLossConcealer::init(int channelCount, float sampleRate)
+        {
+            mChannelCount = channelCount;
+            mMinPeriod = std::max(static_cast<int>(sMinPeriodTime * sampleRate), 1);
+            mMaxPeriod = std::max(static_cast<int>(sMaxPeriodTime * sampleRate), mMinPeriod);
+            mMatchSize = std::max(static_cast<int>(sMatchTime * sampleRate), 1);
+            mHistorySize = mMaxPeriod + mMatchSize;
+            mFadeStart = static_cast<int>(sFadeStartTime * sampleRate);
+            mFadeLength = std::max(static_cast<int>(sFadeTime * sampleRate), 1);
+            mRecoverySize = std::min(std::max(static_cast<int>(sRecoveryTime * sampleRate), 1), sOutputSize);
+
+            mHistory.assign(static_cast<size_t>(channelCount) * mHistorySize, 0.0f);
+            mHistoryChannels.resize(channelCount);
+            for (int channel = 0; channel < channelCount; channel++)
+                mHistoryChannels[channel] = &mHistory[static_cast<size_t>(channel) * mHistorySize];
+            mMix.assign(mHistorySize, 0.0f);
+            mStartOffsets.assign(channelCount, 0.0f);
+
+            mOutputStride = sOutputSize;
+            mOutput.assign(static_cast<size_t>(channelCount) * mOutputStride, 0.0f);
+            mActive = false;
+        }
+
+
+        void PacketLossConcealer::start(int historyCount)
+        {
+            mActive = true;
+            mPeriod = 0;
+            mPhase = 0;
+            mConcealed = 0;
+            mOverlap = 0;
+            if (historyCount < mHistorySize)
+                return;
+
+            // search the period on the sum of all channels, so all channels repeat the same period
+            std::fill(mMix.begin(), mMix.end(), 0.0f);
+            for (int channel = 0; channel < mChannelCount; channel++)
+            {
+                const float* history = mHistoryChannels[channel];
+                for (int i = 0; i < mHistorySize; i++)
+                    mMix[i] += history[i];
+            }
+
+            // find the period at which the samples before the loss resemble the last samples before the loss the most,
+            // repeating that period continues the waveform without a discontinuity
+            const float* target = &mMix[mHistorySize - mMatchSize];
+            double candidate_energy = 0.0;
+            for (int i = 0; i < mMatchSize; i++)
+            {
+                double const value = target[i - mMinPeriod];
+                candidate_energy += value * value;
+            }
+
+            mPeriod = mMaxPeriod;
+            double best_score = 0.0;
+            for (int period = mMinPeriod; period <= mMaxPeriod; period++)
+            {
+                const float* candidate = target - period;
+                double correlation = 0.0;
+                for (int i = 0; i < mMatchSize; i++)
+                    correlation += static_cast<double>(target[i]) * candidate[i];
+
+                // normalize by the energy of the candidate, the energy of the target is the same for all candidates
+                if (correlation > 0.0 && candidate_energy > 0.0)
+                {
+                    double const score = correlation * correlation / candidate_energy;
+                    if (score > best_score)
+                    {
+                        best_score = score;
+                        mPeriod = period;
+                    }
+                }
+
+                // slide the candidate window one sample back
+                if (period < mMaxPeriod)
+                {
+                    double const added = candidate[-1];
+                    double const removed = candidate[mMatchSize - 1];
+                    candidate_energy = std::max(candidate_energy + added * added - removed * removed, 0.0);
+                }
+            }
+
+            // the repetition starts at the sample following the period, it continues the sample preceding the period
+            // instead of the last sample before the loss: the difference between the two is faded out over the overlap
+            mOverlap = std::min(std::max(mPeriod / 4, 1), mHistorySize - mPeriod);
+            for (int channel = 0; channel < mChannelCount; channel++)
+            {
+                const float* history = mHistoryChannels[channel];
+                mStartOffsets[channel] = history[mHistorySize - 1] - history[mHistorySize - mPeriod - 1];
+            }
+        }
+
+
+        float PacketLossConcealer::getGain(int offset) const
+        {
+            int const position = mConcealed + offset - mFadeStart;
+            if (position <= 0)
+                return 1.0f;
+            return std::max(1.0f - static_cast<float>(position) / mFadeLength, 0.0f);
+        }
+
+
+        float PacketLossConcealer::getRepeated(int channel, int offset) const
+        {
+            const float* history = mHistoryChannels[channel];
+            int const position = (mPhase + offset) % mPeriod;
+            float sample = history[mHistorySize - mPeriod + position];
+
+            // overlap-add the end of the period with the samples preceding the period,
+            // these lead into the start of the period so the wrap to the start is continuous
+            int const overlap_position = position - (mPeriod - mOverlap);
+            if (overlap_position >= 0)
+            {
+                float const fade = static_cast<float>(overlap_position + 1) / (mOverlap + 1);
+                sample = sample * (1.0f - fade) + history[mHistorySize - mPeriod - mOverlap + overlap_position] * fade;
+            }
+
+            // fade out the difference between the last sample before the loss and the sample preceding the period
+            int const start_position = mConcealed + offset;
+            if (start_position < mOverlap)
+                sample += mStartOffsets[channel] * (1.0f - static_cast<float>(start_position + 1) / (mOverlap + 1));
+
+            return sample;
+        }
+
+
+        int PacketLossConcealer::conceal(int frameCount)
+        {
+            if (mPeriod == 0 || getGain(0) <= 0.0f)
+            {
+                mConcealed += frameCount;
+                return 0;
+            }
+
+            int const count = std::min(frameCount, mOutputStride);
+            for (int channel = 0; channel < mChannelCount; channel++)
+            {
+                float* output = &mOutput[static_cast<size_t>(channel) * mOutputStride];
+                for (int i = 0; i < count; i++)
+                    output[i] = getGain(i) * getRepeated(channel, i);
+            }
+
+            mPhase = (mPhase + count) % mPeriod;
+            mConcealed += count;
+            return count;
+        }
+
+
+        int PacketLossConcealer::recover(const float* samples, int channelStride, int frameCount)
+        {
+            mActive = false;
+            int const count = std::min(frameCount, mRecoverySize);
+            for (int channel = 0; channel < mChannelCount; channel++)
+            {
+                const float* input = samples + static_cast<size_t>(channel) * channelStride;
+                float* output = &mOutput[static_cast<size_t>(channel) * mOutputStride];
+                for (int i = 0; i < count; i++)
+                {
+                    float const fade = static_cast<float>(i + 1) / (count + 1);
+                    float const repeated = mPeriod > 0 ? getGain(i) * getRepeated(channel, i) : 0.0f;
+                    output[i] = repeated * (1.0f - fade) + input[i] * fade;
+                }
+            }
+            return count;
+        }
+
+	}
+}
@@ -0,0 +1,115 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Nap includes
+#include <utility/dllexport.h>
+
+// Std includes
+#include <vector>
+
+namespace nap
+{
+	namespace audio
+	{
+
+        /**
+         * Synthesizes a replacement for lost audio from the audio that was played before the loss.
+         * On the start of a loss the pitch period of the history is found by a normalized cross correlation search,
+         * the last period is then repeated for as long as the loss lasts. The repetition is overlap-added over a quarter period
+         * at the start of the loss and on every wrap of the period, so it doesn't click. After 10 ms the repetition fades out, it is
+         * silent after 60 ms. When audio arrives again, its first samples are crossfaded with the continued repetition.
+         * The same period is used for all channels, so the channels stay coherent.
+         * All memory is allocated on init, the concealer is used from the thread queueing the audio.
+         */
+        class NAPAPI PacketLossConcealer
+        {
+        public:
+            /**
+             * Allocates the history and output storage, not thread safe
+             * @param channelCount number of channels
+             * @param sampleRate sample rate of the concealed audio
+             */
+            void init(int channelCount, float sampleRate);
+
+            /**
+             * @return number of samples per channel of history the pitch search needs
+             */
+            int getHistorySize() const { return mHistorySize; }
+
+            /**
+             * @return one pointer per channel the history has to be copied to before start() is called
+             */
+            float* const* getHistory() { return mHistoryChannels.data(); }
+
+            /**
+             * Starts concealment of a loss, finds the pitch period of the history.
+             * @param historyCount number of samples per channel copied to getHistory(), the repetition stays silent when less than getHistorySize()
+             */
+            void start(int historyCount);
+
+            /**
+             * @return true between start() and recover()
+             */
+            bool isActive() const { return mActive; }
+
+            /**
+             * Synthesizes the next samples of the loss into the output.
+             * @param frameCount number of samples per channel requested
+             * @return number of samples per channel synthesized into getOutput(), 0 once the repetition faded out completely
+             */
+            int conceal(int frameCount);
+
+            /**
+             * Ends concealment, crossfades the start of the audio following the loss with the continued repetition into the output.
+             * @param samples planar samples following the loss, channel c starts at samples + c * channelStride
+             * @param channelStride distance between the channels in the input
+             * @param frameCount number of samples per channel in the input
+             * @return number of samples per channel written to getOutput(), these replace the first samples of the input
+             */
+            int recover(const float* samples, int channelStride, int frameCount);
+
+            /**
+             * @return planar output of the last conceal() or recover() call, channel c starts at getOutput() + c * getOutputStride()
+             */
+            const float* getOutput() const { return mOutput.data(); }
+
+            /**
+             * @return distance between the channels in the output
+             */
+            int getOutputStride() const { return mOutputStride; }
+
+        private:
+            // Returns the gain of the repetition at the given offset from the current position in the loss
+            float getGain(int offset) const;
+
+            // Returns the sample of the repetition of a channel at the given offset from the current position
+            float getRepeated(int channel, int offset) const;
+
+            int mChannelCount = 0;
+            int mMinPeriod = 0;             // Shortest pitch period searched for
+            int mMaxPeriod = 0;             // Longest pitch period searched for
+            int mMatchSize = 0;             // Number of samples correlated per candidate period
+            int mHistorySize = 0;           // mMaxPeriod + mMatchSize
+            int mFadeStart = 0;             // Number of concealed samples after which the repetition starts fading out
+            int mFadeLength = 0;            // Number of samples from the start of the fade until silence
+            int mRecoverySize = 0;          // Max number of samples crossfaded when audio arrives again
+
+            std::vector<float> mHistory;    // Per channel: the last mHistorySize samples before the loss
+            std::vector<float*> mHistoryChannels;
+            std::vector<float> mMix;        // Sum of all channels of the history, used for the pitch search
+            std::vector<float> mStartOffsets;   // Per channel: last sample before the loss minus the sample preceding the period
+            std::vector<float> mOutput;     // Per channel: synthesized samples
+            int mOutputStride = 0;
+
+            bool mActive = false;
+            int mPeriod = 0;                // Repeated period in samples, 0 when the history is too short
+            int mPhase = 0;                 // Position in the repeated period
+            int mOverlap = 0;               // Number of samples overlap-added at the start of the loss and on every wrap of the period
+            int mConcealed = 0;             // Number of samples per channel concealed since start()
+        };
+
+	}
+}
@@ -0,0 +1,161 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "polyphaseresampler.h"
+
+// Std includes
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace nap
+{
+	namespace audio
+	{
+        static constexpr double sPi = 3.14159265358979323846;
+
+
+        /**
+         * Zeroth order modified bessel function of the first kind, used by the kaiser window
+         */
+        static double besselI0(double x)
+        {
+            double sum = 1.0;
+            double term = 1.0;
+            double const half_x = x * 0.5;
+            for (int k = 1; k < 64; k++)
+            {
+                term *= (half_x / k) * (half_x / k);
+                sum += term;
+                if (term < sum * 1e-12)
+                    break;
+            }
+            return sum;
+        }
+
+
+        void PolyphaseResampler::init(int inputRate, int outputRate, int channelCount, int maxInputFrames, EResampleQuality quality)
+        {
+            assert(inputRate > 0 && outputRate > 0);
+            mInputRate = inputRate;
+            mOutputRate = outputRate;
+            mChannelCount = channelCount;
+            mMaxInputFrames = maxInputFrames;
+
+            // reduce the ratio, e.g. 44100 -> 48000 becomes 160 / 147
+            int const divisor = std::gcd(inputRate, outputRate);
+            mUpFactor = outputRate / divisor;
+            mDownFactor = inputRate / divisor;
+
+            // taps per phase and kaiser window shape per quality
+            int base_taps = 16;
+            double beta = 7.0;
+            double rolloff = 0.9;
+            switch (quality)
+            {
+            case EResampleQuality::Low:
+                base_taps = 8; beta = 5.0; rolloff = 0.85;
+                break;
+            case EResampleQuality::Medium:
+                base_taps = 16; beta = 7.0; rolloff = 0.9;
+                break;
+            case EResampleQuality::High:
+                base_taps = 32; beta = 9.0; rolloff = 0.94;
+                break;
+            }
+
+            // when downsampling the cutoff lowers, so more taps are needed for the same transition steepness
+            int const stretch = (mDownFactor + mUpFactor - 1) / mUpFactor;
+            mTaps = base_taps * std::max(stretch, 1);
+
+            // design the prototype lowpass at the upsampled rate
+            int const length = mTaps * mUpFactor;
+            double const cutoff = 0.5 * rolloff / std::max(mUpFactor, mDownFactor);
+            double const center = (length - 1) * 0.5;
+            double const i0_beta = besselI0(beta);
+            std::vector<double> prototype(length);
+            for (int n = 0; n < length; n++)
+            {
+                double const x = n - center;
+                double const sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * sPi * cutoff * x) / (sPi * x);
+                double const r = length > 1 ? (2.0 * n / (length - 1) - 1.0) : 0.0;
+                double const window = besselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / i0_beta;
+                prototype[n] = sinc * window * mUpFactor;
+            }
+
+            // split into phases, stored reversed so a phase is a forward dot product with the input history
+            mCoefficients.assign(static_cast<size_t>(length), 0.0f);
+            for (int phase = 0; phase < mUpFactor; phase++)
+            {
+                float* coefficients = &mCoefficients[static_cast<size_t>(phase) * mTaps];
+                for (int k = 0; k < mTaps; k++)
+                    coefficients[mTaps - 1 - k] = static_cast<float>(prototype[static_cast<size_t>(k) * mUpFactor + phase]);
+            }
+
+            mMaxOutputFrames = static_cast<int>((static_cast<long long>(maxInputFrames) * mUpFactor) / mDownFactor) + 2;
+            mHistory.assign(static_cast<size_t>(channelCount) * (mTaps - 1 + maxInputFrames), 0.0f);
+            reset();
+        }
+
+
+        int PolyphaseResampler::process(const float* input, int inputFrames, float* output, int outputStride)
+        {
+            assert(inputFrames <= mMaxInputFrames);
+            assert(outputStride >= mMaxOutputFrames);
+
+            int const history_size = mTaps - 1;
+            int const channel_size = history_size + mMaxInputFrames;
+            long long const block_end = static_cast<long long>(inputFrames) * mUpFactor;
+
+            int produced = 0;
+            for (int channel = 0; channel < mChannelCount; channel++)
+            {
+                float* history = &mHistory[static_cast<size_t>(channel) * channel_size];
+                std::memcpy(history + history_size, input + static_cast<size_t>(channel) * inputFrames, inputFrames * sizeof(float));
+
+                // the window of input sample i spans history[i, i + taps)
+                float* channel_output = output + static_cast<size_t>(channel) * outputStride;
+                int count = 0;
+                for (long long time = mTime; time < block_end; time += mDownFactor)
+                {
+                    int const index = static_cast<int>(time / mUpFactor);
+                    int const phase = static_cast<int>(time % mUpFactor);
+                    const float* coefficients = &mCoefficients[static_cast<size_t>(phase) * mTaps];
+                    const float* window = history + index;
+
+                    float sum = 0.0f;
+                    for (int k = 0; k < mTaps; k++)
+                        sum += coefficients[k] * window[k];
+                    channel_output[count++] = sum;
+                }
+                produced = count;
+
+                // keep the last samples as history for the next block
+                std::memmove(history, history + inputFrames, history_size * sizeof(float));
+            }
+
+            // advance to the next block
+            long long const steps = mTime < block_end ? (block_end - mTime + mDownFactor - 1) / mDownFactor : 0;
+            mTime += steps * mDownFactor - block_end;
+
+            return produced;
+        }
+
+
+        void PolyphaseResampler::reset()
+        {
+            std::fill(mHistory.begin(), mHistory.end(), 0.0f);
+            mTime = 0;
+        }
+
+
+        int PolyphaseResampler::toOutputFrames(int inputFrames) const
+        {
+            return static_cast<int>((static_cast<long long>(inputFrames) * mUpFactor + mDownFactor / 2) / mDownFactor);
+        }
+
+	}
+}
@@ -0,0 +1,102 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Std includes
+#include <vector>
+
+// Nap includes
+#include <utility/dllexport.h>
+
+namespace nap
+{
+	namespace audio
+	{
+
+        /**
+         * Quality of the polyphase resampler, higher quality uses longer filters and more CPU
+         */
+        enum class EResampleQuality : int
+        {
+            Low     = 0,    ///< 8 taps per phase, suitable for speech and monitoring
+            Medium  = 1,    ///< 16 taps per phase
+            High    = 2     ///< 32 taps per phase, transparent for music
+        };
+
+
+        /**
+         * Converts multichannel audio between two fixed sample rates using a windowed sinc polyphase filter.
+         * The conversion ratio is reduced to the rational L/M, every output sample is a single dot product
+         * of L precomputed filter phases with a contiguous window of input history, which the compiler can vectorize.
+         * All memory is allocated on init, processing does not allocate.
+         */
+        class NAPAPI PolyphaseResampler
+        {
+        public:
+            /**
+             * Computes the filter and allocates the channel history
+             * @param inputRate sample rate of the input
+             * @param outputRate sample rate of the output
+             * @param channelCount number of channels to convert
+             * @param maxInputFrames max number of samples per channel passed to a single process call
+             * @param quality the filter quality
+             */
+            void init(int inputRate, int outputRate, int channelCount, int maxInputFrames, EResampleQuality quality);
+
+            /**
+             * Converts a block of planar input, channel c starts at input + c * inputFrames.
+             * The output is written planar as well, channel c starts at output + c * outputStride.
+             * @param input planar input samples
+             * @param inputFrames number of samples per channel, at most the max given on init
+             * @param output planar output samples
+             * @param outputStride distance between the channels in the output, at least getMaxOutputFrames()
+             * @return number of samples per channel written to the output
+             */
+            int process(const float* input, int inputFrames, float* output, int outputStride);
+
+            /**
+             * Clears the input history
+             */
+            void reset();
+
+            /**
+             * @return the max number of samples per channel a single process call produces
+             */
+            int getMaxOutputFrames() const { return mMaxOutputFrames; }
+
+            /**
+             * @return the sample rate of the input the resampler was initialized with
+             */
+            int getInputRate() const { return mInputRate; }
+
+            /**
+             * @return the sample rate of the output the resampler was initialized with
+             */
+            int getOutputRate() const { return mOutputRate; }
+
+            /**
+             * Converts a number of input samples to the equivalent number of output samples
+             * @param inputFrames number of input samples
+             * @return the number of output samples, rounded
+             */
+            int toOutputFrames(int inputFrames) const;
+
+        private:
+            int mInputRate = 0;
+            int mOutputRate = 0;
+            int mUpFactor = 1;              // L
+            int mDownFactor = 1;            // M
+            int mTaps = 0;                  // Filter taps per phase
+            int mChannelCount = 0;
+            int mMaxInputFrames = 0;
+            int mMaxOutputFrames = 0;
+            long long mTime = 0;            // Position of the next output sample in upsampled time, relative to the current block
+
+            std::vector<float> mCoefficients;   // mUpFactor phases of mTaps reversed coefficients
+            std::vector<float> mHistory;        // Per channel: mTaps - 1 samples of history followed by the current block
+        };
+
+	}
+}
@@ -7,10 +7,12 @@
 
 #include <nap/logger.h>
 
+// Std includes
+#include <cmath>
+
 RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::audio::SampleQueuePlayerNode)
-RTTI_PROPERTY("audioOutput", &nap::audio::SampleQueuePlayerNode::audioOutput, nap::rtti::EPropertyMetaData::Embedded)
 RTTI_PROPERTY("maxQueueSize", &nap::audio::SampleQueuePlayerNode::mMaxQueueSize, nap::rtti::EPropertyMetaData::Default)
-RTTI_PROPERTY("verbose", &nap::audio::SampleQueuePlayerNode::mMaxQueueSize, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("verbose", &nap::audio::SampleQueuePlayerNode::mVerbose, nap::rtti::EPropertyMetaData::Default)
 RTTI_END_CLASS
 
 namespace nap
@@ -18,67 +20,417 @@ namespace nap
 
 	namespace audio
 	{
+        // Time constant of the queue fill smoothing used by the target latency playout
+        static constexpr double sLatencySmoothingTime = 0.05;
+
 
-		SampleQueuePlayerNode::SampleQueuePlayerNode(NodeManager& manager) : Node(manager)
+		SampleQueuePlayerNode::SampleQueuePlayerNode(NodeManager& manager, int channelCount, int maxQueueSize) : Node(manager), mMaxQueueSize(maxQueueSize)
 		{
             mBufferSize = getBufferSize();
-            mSamples = std::vector<SampleValue>(mBufferSize);
+
+            for (int channel = 0; channel < channelCount; channel++)
+                mOutputs.emplace_back(std::make_unique<OutputPin>(this));
+            mDestinations.resize(channelCount, nullptr);
+
+            // room for a full queue plus the block that is being queued when the max queue size is reached,
+            // and at least the history the concealer analyses
+            mConcealer.init(channelCount, getNodeManager().getSampleRate());
+            mQueue.init(channelCount, math::max(math::max(maxQueueSize, mBufferSize) * 2, mConcealer.getHistorySize()));
+            mSilence = std::vector<float>(static_cast<size_t>(mConcealer.getHistorySize()), 0.0f);
+
+            // enough room for a block at the max drift ratio plus interpolation history
+            mResampleStride = mBufferSize * 2 + 8;
+            mResampleBuffer = std::vector<SampleValue>(static_cast<size_t>(channelCount) * mResampleStride, 0.0f);
+            mResampleCount = 1;
+            mReadPosition = 1.0;
+
+            // skip or repeat at most a quarter block at once, crossfaded over the rest of the block
+            mCorrectionSize = math::max(mBufferSize / 4, 1);
+            mCorrectionBuffer = std::vector<SampleValue>(static_cast<size_t>(channelCount) * (mBufferSize + mCorrectionSize), 0.0f);
 		}
 
 
-		void SampleQueuePlayerNode::queueSamples(const float* samples, size_t numSamples)
+        void SampleQueuePlayerNode::setDriftController(std::shared_ptr<ClockDriftController> controller)
+        {
+            getNodeManager().enqueueTask([this, controller]()
+            {
+                mDriftController = controller;
+            });
+        }
+
+
+        void SampleQueuePlayerNode::setLatencyMonitor(VBANLatencyMonitor* monitor)
+        {
+            getNodeManager().enqueueTask([this, monitor]()
+            {
+                mLatencyMonitor = monitor;
+            });
+        }
+
+
+        void SampleQueuePlayerNode::setTargetLatency(int samples)
+        {
+            getNodeManager().enqueueTask([this, samples]()
+            {
+                mTargetLatency = math::max(samples, 0);
+                mPrefilling = true;
+            });
+        }
+
+
+		void SampleQueuePlayerNode::queueSamples(const float* samples, int channelStride, size_t numSamples)
 		{
+            // the queue drained while suspended, restore the latency the stream had before
+            if (mSuspended)
+            {
+                mSuspended = false;
+                queueSilence(math::max(mResumeLatency - mQueue.getReadAvailable(), 0));
+                mIdle.store(false, std::memory_order_release);
+            }
+
+            int const count = static_cast<int>(numSamples);
+            if (mConcealer.isActive() && mQueue.getReadAvailable() <= mMaxQueueSize && mQueue.getWriteAvailable() >= count)
+            {
+                // first samples after a concealed gap, crossfade from the concealment into the samples
+                int const crossfaded = mConcealer.recover(samples, channelStride, count);
+                mQueue.write(mConcealer.getOutput(), mConcealer.getOutputStride(), crossfaded);
+                mQueue.write(samples + crossfaded, channelStride, count - crossfaded);
+                return;
+            }
+
             // check if queue size is exceeded, if so throw a warning, if not queue the samples
-            if(mQueue.size_approx() <= mMaxQueueSize)
+            if(mQueue.getReadAvailable() <= mMaxQueueSize && mQueue.write(samples, channelStride, count))
+                return;
+
+            mDroppedSamples.add(numSamples);
+            if(mVerbose)
+                nap::Logger::warn("%s: Dropping samples because buffer is getting to big", std::string(get_type().get_name()).c_str());
+		}
+
+
+		void SampleQueuePlayerNode::queueGap(size_t numSamples)
+		{
+            int const count = static_cast<int>(numSamples);
+            if (!mConcealment)
+            {
+                if(mQueue.getReadAvailable() <= mMaxQueueSize && mQueue.writeSilence(count))
+                    return;
+
+                mDroppedSamples.add(numSamples);
+                return;
+            }
+
+            if (mQueue.getReadAvailable() > mMaxQueueSize || mQueue.getWriteAvailable() < count)
             {
-                if (!mQueue.enqueue_bulk(samples, numSamples))
+                mDroppedSamples.add(numSamples);
+                return;
+            }
+
+            // the history is still in the queue, consecutive gaps continue the running concealment
+            if (!mConcealer.isActive())
+                mConcealer.start(mQueue.copyLatest(mConcealer.getHistory(), mConcealer.getHistorySize()));
+
+            int remaining = count;
+            while (remaining > 0)
+            {
+                int const concealed = mConcealer.conceal(remaining);
+                if (concealed == 0)
                 {
-                    nap::Logger::error("%s: Failed to allocate memory for queue buffer",  std::string(get_type().get_name()).c_str());
+                    // faded out completely
+                    mQueue.writeSilence(remaining);
+                    break;
                 }
-            }else
-            {
-                if(mVerbose)
-                    nap::Logger::warn("%s: Dropping samples because buffer is getting to big", std::string(get_type().get_name()).c_str());
+                mQueue.write(mConcealer.getOutput(), mConcealer.getOutputStride(), concealed);
+                remaining -= concealed;
             }
+            mConcealedSamples.add(numSamples);
 		}
 
 
+        void SampleQueuePlayerNode::suspend()
+        {
+            if (mSuspended)
+                return;
+
+            mSuspended = true;
+            mResumeLatency = static_cast<int>(getLatency() + 0.5f);
+            mIdle.store(true, std::memory_order_release);
+        }
+
+
+        void SampleQueuePlayerNode::queueSilence(int numSamples)
+        {
+            if (numSamples == 0)
+                return;
+
+            if (mQueue.getReadAvailable() > mMaxQueueSize || mQueue.getWriteAvailable() < numSamples)
+            {
+                mDroppedSamples.add(numSamples);
+                return;
+            }
+
+            // a running concealment fades into the silence, all channels read the same silent input
+            int remaining = numSamples;
+            if (mConcealer.isActive())
+            {
+                int const crossfaded = mConcealer.recover(mSilence.data(), 0, math::min(remaining, static_cast<int>(mSilence.size())));
+                mQueue.write(mConcealer.getOutput(), mConcealer.getOutputStride(), crossfaded);
+                remaining -= crossfaded;
+            }
+            mQueue.writeSilence(remaining);
+        }
+
+
 		void SampleQueuePlayerNode::process()
 		{
+            uint64_t const read_position = mQueue.getReadPosition();
+            playQueue();
+            if (mLatencyMonitor != nullptr)
+                mLatencyMonitor->samplesPlayed(read_position, mQueue.getReadPosition(), mBufferSize, getNodeManager().getSampleRate());
+		}
+
+
+        void SampleQueuePlayerNode::playQueue()
+        {
+            // the sender suspended the stream, running out of samples is not an underrun
+            if (mIdle.load(std::memory_order_acquire))
+            {
+                int const available = mQueue.getReadAvailable();
+                if (available < mBufferSize)
+                {
+                    playSuspended(available);
+                    return;
+                }
+            }
+
+            if (mDriftController != nullptr)
+            {
+                processResampled();
+                return;
+            }
+
+            if (mTargetLatency > 0)
+            {
+                if (processTargetLatency())
+                    return;
+
+                // prefilling, play silence until the queue reaches the target
+                mQueueFill.record(mQueue.getReadAvailable());
+                for (auto& output : mOutputs)
+                {
+                    auto& outputBuffer = getOutputBuffer(*output);
+                    std::fill(outputBuffer.begin(), outputBuffer.end(), 0.0f);
+                }
+                return;
+            }
+
             // get buffer size
-            const int available_samples = mQueue.size_approx();
-            int buffer_size_to_copy = available_samples;
-            if(available_samples > mBufferSize)
-                buffer_size_to_copy = mBufferSize;
+            const int available_samples = mQueue.getReadAvailable();
+            mQueueFill.record(available_samples);
+            mLatency.store(static_cast<float>(available_samples), std::memory_order_relaxed);
+            if(available_samples < mBufferSize)
+                mUnderruns.add();
 
-            // if the amount of samples in the queue exceeds buffer sized used by audio service we can fill the outputbuffer
-            if(buffer_size_to_copy > 0)
+            // if sample buffer is smaller the buffersize fill beginning with silence
+            int const silent_samples_num = math::max(mBufferSize - available_samples, 0);
+            for (int channel = 0; channel < getChannelCount(); channel++)
             {
-                // get output buffer
-                auto& outputBuffer = getOutputBuffer(audioOutput);
+                auto& outputBuffer = getOutputBuffer(*mOutputs[channel]);
+                std::fill(outputBuffer.begin(), outputBuffer.begin() + silent_samples_num, 0.0f);
+                mDestinations[channel] = outputBuffer.data() + silent_samples_num;
+            }
+
+            // dequeue the samples of all channels straight into the output buffers
+            if(available_samples > 0)
+            {
+                mQueue.read(mDestinations.data(), mBufferSize - silent_samples_num);
+            }else
+            {
+                // no samples in queue, filled with silence
+                if(mVerbose)
+                    nap::Logger::warn("%s: Not enough samples in queue", std::string(get_type().get_name()).c_str());
+            }
+        }
+	
+
+        void SampleQueuePlayerNode::playSuspended(int available)
+        {
+            // samples queued after the fill was sampled are played in the next block
+            available = math::min(available, mBufferSize);
+            mQueueFill.record(available);
+            mLatency.store(static_cast<float>(available), std::memory_order_relaxed);
 
-                // if sample buffer is smaller the buffersize fill beginning with silence
-                int silent_samples_num = mBufferSize - available_samples;
-                silent_samples_num = math::max(silent_samples_num, 0);
-                if(silent_samples_num > 0)
+            // playback waits for the target latency again once the stream resumes
+            mPrefilling = true;
+            for (int channel = 0; channel < getChannelCount(); channel++)
+            {
+                auto& outputBuffer = getOutputBuffer(*mOutputs[channel]);
+                std::fill(outputBuffer.begin() + available, outputBuffer.end(), 0.0f);
+                mDestinations[channel] = outputBuffer.data();
+            }
+            mQueue.read(mDestinations.data(), available);
+        }
+
+
+        /**
+         * 4 point cubic hermite interpolation between x0 and x1
+         */
+        static inline float interpolateHermite(float xm1, float x0, float x1, float x2, float t)
+        {
+            float const c1 = 0.5f * (x1 - xm1);
+            float const c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+            float const c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+            return ((c3 * t + c2) * t + c1) * t + x0;
+        }
+
+
+        void SampleQueuePlayerNode::processResampled()
+        {
+            float const queue_fill = static_cast<float>(mQueue.getReadAvailable()) + static_cast<float>(mResampleCount - mReadPosition);
+            double const ratio = mDriftController->update(getNodeManager().getSampleTime(), queue_fill);
+            mQueueFill.record(static_cast<uint32_t>(queue_fill));
+            mLatency.store(mDriftController->getFilteredFill(), std::memory_order_relaxed);
+
+            // dequeue the samples needed to interpolate the last sample of this block
+            int const needed = static_cast<int>(mReadPosition + (mBufferSize - 1) * ratio) + 3 - mResampleCount;
+            if (needed > 0)
+            {
+                for (int channel = 0; channel < getChannelCount(); channel++)
+                    mDestinations[channel] = &mResampleBuffer[static_cast<size_t>(channel) * mResampleStride + mResampleCount];
+                mResampleCount += mQueue.read(mDestinations.data(), math::min(needed, mResampleStride - mResampleCount));
+            }
+
+            // all channels are interpolated at the same positions
+            int produced = 0;
+            double position = mReadPosition;
+            for (int channel = 0; channel < getChannelCount(); channel++)
+            {
+                auto& outputBuffer = getOutputBuffer(*mOutputs[channel]);
+                const SampleValue* history = &mResampleBuffer[static_cast<size_t>(channel) * mResampleStride];
+
+                int i = 0;
+                position = mReadPosition;
+                for (; i < mBufferSize; i++)
                 {
-                    std::fill(outputBuffer.begin(), outputBuffer.begin() + silent_samples_num, 0.0f);
+                    int const index = static_cast<int>(position);
+                    if (index + 2 >= mResampleCount)
+                        break;
+
+                    float const t = static_cast<float>(position - index);
+                    outputBuffer[i] = interpolateHermite(history[index - 1], history[index], history[index + 1], history[index + 2], t);
+                    position += ratio;
                 }
 
-                // dequeue the samples from the queue and fill the rest with the outputbuffer
-                if(mQueue.try_dequeue_bulk(mSamples.begin(), buffer_size_to_copy))
+                // not enough samples in queue, fill the rest with silence
+                std::fill(outputBuffer.begin() + i, outputBuffer.end(), 0.0f);
+                produced = i;
+            }
+            mReadPosition = position;
+
+            if (produced < mBufferSize)
+            {
+                mUnderruns.add();
+                if(mVerbose)
+                    nap::Logger::warn("%s: Not enough samples in queue", std::string(get_type().get_name()).c_str());
+            }
+
+            // discard consumed samples, keep one sample of history before the read position
+            int const consumed = math::min<int>(static_cast<int>(mReadPosition) - 1, mResampleCount);
+            if (consumed > 0)
+            {
+                for (int channel = 0; channel < getChannelCount(); channel++)
                 {
-                    // fill the output buffer
-                    std::memcpy(&outputBuffer.data()[silent_samples_num], mSamples.data(), buffer_size_to_copy * sizeof(SampleValue));
+                    SampleValue* history = &mResampleBuffer[static_cast<size_t>(channel) * mResampleStride];
+                    std::memmove(history, history + consumed, (mResampleCount - consumed) * sizeof(SampleValue));
                 }
-            }else
+                mResampleCount -= consumed;
+                mReadPosition -= consumed;
+            }
+        }
+	
+
+        bool SampleQueuePlayerNode::processTargetLatency()
+        {
+            int const available = mQueue.getReadAvailable();
+            if (mPrefilling)
             {
-                // no samples in queue, fill with silence
+                if (available < mTargetLatency)
+                    return false;
+                mPrefilling = false;
+                mSmoothedFill = available;
+            }
+            mQueueFill.record(available);
+
+            // smooth out the saw tooth caused by packets arriving in bursts
+            double const smoothing = 1.0 - std::exp(-mBufferSize / (sLatencySmoothingTime * getNodeManager().getSampleRate()));
+            mSmoothedFill += (available - mSmoothedFill) * smoothing;
+            mLatency.store(static_cast<float>(mSmoothedFill), std::memory_order_relaxed);
+
+            // skip samples when too far behind, repeat samples when too close, within a tolerance of half a block
+            double const error = mSmoothedFill - mTargetLatency;
+            double const tolerance = math::max(mBufferSize / 2, mCorrectionSize);
+            int correction = 0;
+            if (error > tolerance)
+                correction = static_cast<int>(math::min<double>(error - tolerance, mCorrectionSize));
+            else if (error < -tolerance)
+                correction = -static_cast<int>(math::min<double>(-error - tolerance, mCorrectionSize));
+
+            // never skip more than what is queued beyond this block
+            if (correction > 0)
+                correction = math::min(correction, math::max(available - mBufferSize, 0));
+
+            int const needed = mBufferSize + correction;
+            if (available < needed)
+            {
+                // ran empty, play what is left and prefill again
+                mUnderruns.add();
                 if(mVerbose)
                     nap::Logger::warn("%s: Not enough samples in queue", std::string(get_type().get_name()).c_str());
-                auto& outputBuffer = getOutputBuffer(audioOutput);
-                std::fill(outputBuffer.begin(), outputBuffer.end(), 0.0f);
+                for (int channel = 0; channel < getChannelCount(); channel++)
+                {
+                    auto& outputBuffer = getOutputBuffer(*mOutputs[channel]);
+                    std::fill(outputBuffer.begin() + available, outputBuffer.end(), 0.0f);
+                    mDestinations[channel] = outputBuffer.data();
+                }
+                mQueue.read(mDestinations.data(), available);
+                mPrefilling = true;
+                return true;
             }
-		}
+
+            // on target, dequeue straight into the output buffers
+            if (correction == 0)
+            {
+                for (int channel = 0; channel < getChannelCount(); channel++)
+                    mDestinations[channel] = getOutputBuffer(*mOutputs[channel]).data();
+                mQueue.read(mDestinations.data(), mBufferSize);
+                return true;
+            }
+
+            int const stride = mBufferSize + mCorrectionSize;
+            for (int channel = 0; channel < getChannelCount(); channel++)
+                mDestinations[channel] = &mCorrectionBuffer[static_cast<size_t>(channel) * stride];
+            mQueue.read(mDestinations.data(), needed);
+
+            // crossfade from the signal to the same signal shifted by the correction, which drops or repeats that many samples
+            int const shift = correction > 0 ? correction : -correction;
+            int const fade_start = correction > 0 ? 0 : shift;
+            int const fade_length = math::max(correction > 0 ? mBufferSize - 1 : mBufferSize - 2 * shift, 1);
+            for (int channel = 0; channel < getChannelCount(); channel++)
+            {
+                auto& outputBuffer = getOutputBuffer(*mOutputs[channel]);
+                const SampleValue* block = &mCorrectionBuffer[static_cast<size_t>(channel) * stride];
+                for (int i = 0; i < mBufferSize; i++)
+                {
+                    float const fade = math::min(math::max(static_cast<float>(i - fade_start) / fade_length, 0.0f), 1.0f);
+                    float const current = correction > 0 || i < needed ? block[i] : 0.0f;
+                    float const shifted = correction > 0 ? block[i + shift] : (i >= shift ? block[i - shift] : 0.0f);
+                    outputBuffer[i] = current * (1.0f - fade) + shifted * fade;
+                }
+            }
+
+            // the smoothed fill follows the correction right away, avoids correcting twice
+            mSmoothedFill -= correction;
+            return true;
+        }
 	}
 }
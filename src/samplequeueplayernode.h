@@ -4,54 +4,192 @@
 
 #pragma once
 
-// Std includes
-#include <atomic>
-
 // Nap includes
 #include <audio/utility/safeptr.h>
-#include <utility/threading.h>
 
 // Audio includes
 #include <audio/core/audionode.h>
 #include <audio/core/audionodemanager.h>
 
+// Vban includes
+#include "clockdriftcontroller.h"
+#include "multichannelringbuffer.h"
+#include "packetlossconcealer.h"
+#include "vbanlatencymonitor.h"
+#include "vbanstatistics.h"
+
+// Std includes
+#include <atomic>
+#include <memory>
+#include <vector>
+
 namespace nap
 {
 	namespace audio
 	{
 
         /**
-         * Node that allows the queueing of samples from another thread before they are being send through the output pin.
-         *
+         * Node that allows the queueing of multichannel samples from another thread before they are being send through the output pins.
+         * All channels share a single lock free ring buffer, so they stay in sync. The samples have to be queued from a single thread.
          */
 		class NAPAPI SampleQueuePlayerNode : public Node
 		{
 			RTTI_ENABLE(Node)
 
 		public:
-			SampleQueuePlayerNode(NodeManager& manager);
+            /**
+             * Constructor, allocates the queue
+             * @param manager the node manager
+             * @param channelCount number of channels, one output pin is created per channel
+             * @param maxQueueSize the amount of samples per channel that the queue is allowed to have
+             */
+			SampleQueuePlayerNode(NodeManager& manager, int channelCount = 1, int maxQueueSize = 4096);
+
+            /**
+             * Returns the output pin of a channel, no bound checking, assert on out of bound
+             * @param channel the channel
+             * @return the output pin
+             */
+            OutputPin& getOutput(int channel) { assert(channel < static_cast<int>(mOutputs.size())); return *mOutputs[channel]; }
+
+            /**
+             * @return number of channels
+             */
+            int getChannelCount() const { return static_cast<int>(mOutputs.size()); }
+
+            /**
+             * Queue samples of all channels from another thread to be played back through the output pins.
+             * The whole block is dropped when the queue exceeds the max queue size.
+             * @param samples Pointer to planar floating point data, channel c starts at samples + c * channelStride
+             * @param channelStride Distance between the channels in samples
+             * @param numSamples Number of samples per channel to be queued
+             */
+			void queueSamples(const float* samples, int channelStride, size_t numSamples);
+
+            /**
+             * Queue a gap of missing samples from another thread, keeps the following samples at their original position in time.
+             * With concealment enabled the gap is filled with a repetition of the audio before the gap, otherwise it is played back as silence.
+             * @param numSamples Number of samples per channel that are missing
+             */
+            void queueGap(size_t numSamples);
+
+            /**
+             * Marks the stream as suspended by its sender, call from the thread queueing samples.
+             * While suspended the queue is played out and followed by silence, without counting underruns.
+             * When samples are queued again, silence is queued first to restore the latency the queue had when
+             * the stream was suspended, so the stream resumes with the same headroom.
+             */
+            void suspend();
+
+            /**
+             * Enables or disables concealment of gaps, call before samples are queued
+             * @param enable true to conceal gaps, false to play gaps back as silence
+             */
+            void setConcealment(bool enable) { mConcealment = enable; }
+
+            /**
+             * @return number of samples per channel that were concealed, can be called from any thread
+             */
+            uint64_t getConcealedSampleCount() const { return mConcealedSamples.get(); }
+
+            /**
+             * Enables clock drift compensation, the queued samples are resampled with the ratio computed by the controller.
+             * Pass nullptr to disable drift compensation.
+             * @param controller the drift controller
+             */
+            void setDriftController(std::shared_ptr<ClockDriftController> controller);
 
             /**
-             * Connect output to this pin
+             * Enables target latency playout. Playback starts once the queue holds the target amount of samples,
+             * and starts over after the queue ran empty. Deviations from the target are corrected by skipping or
+             * repeating a few samples per block, crossfaded over the block. Pass 0 to disable.
+             * @param samples the number of queued samples per channel to converge to
              */
-			OutputPin audioOutput = {this};
+            void setTargetLatency(int samples);
 
             /**
-             * Queue any amount of samples from another thread to be played back through the outpu pin.
-             * @param samples Pointer to floating point data of sample data
-             * @param numSamples Number of samples to be queued
+             * @return the number of samples per channel waiting to be played, smoothed over the last blocks, can be called from any thread
              */
-			void queueSamples(const float* samples, size_t numSamples);
+            float getLatency() const { return mLatency.load(std::memory_order_relaxed); }
 
-            int mMaxQueueSize = 4096; ///< Property: "MaxQueueSize" the amount of samples that the queue is allowed to have
+            /**
+             * @return number of audio blocks that could not be filled completely from the queue, can be called from any thread
+             */
+            uint64_t getUnderrunCount() const { return mUnderruns.get(); }
+
+            /**
+             * @return number of samples per channel dropped because the queue exceeded the max queue size, can be called from any thread
+             */
+            uint64_t getDroppedSampleCount() const { return mDroppedSamples.get(); }
+
+            /**
+             * @return histogram of the number of queued samples per channel, recorded once every audio block
+             */
+            const VBANHistogram& getQueueFillHistogram() const { return mQueueFill; }
+
+            /**
+             * Reports the samples played every audio block to a latency monitor, pass nullptr to stop reporting.
+             * @param monitor the monitor, has to outlive the node
+             */
+            void setLatencyMonitor(VBANLatencyMonitor* monitor);
+
+            /**
+             * @return position in the queue of the next sample queued, only valid on the thread queueing samples
+             */
+            uint64_t getWritePosition() const { return mQueue.getWritePosition(); }
+
+            int mMaxQueueSize = 4096; ///< Property: "MaxQueueSize" the amount of samples per channel that the queue is allowed to have
             bool mVerbose = false; ///< Property: "Verbose" enable logging
 		private:
 			// Inherited from Node
 			void process() override;
 
-			moodycamel::ConcurrentQueue<float> mQueue;  // New samples are queued here from a different thread.
-            std::vector<SampleValue> mSamples;
+            // Plays the queue back using the configured playout mode
+            void playQueue();
+
+            // Plays what is left in the queue followed by silence while the stream is suspended, available is the fill sampled by playQueue()
+            void playSuspended(int available);
+
+            // Queues silence on the thread queueing samples, ends a running concealment
+            void queueSilence(int numSamples);
+
+            // Plays the queue back resampled with the ratio of the drift controller
+            void processResampled();
+
+            // Plays the queue back at the target latency, returns false when playback has to wait for the prefill
+            bool processTargetLatency();
+
+            std::vector<std::unique_ptr<OutputPin>> mOutputs;
+			MultiChannelRingBuffer mQueue;              // New samples are queued here from a different thread
+            std::vector<float*> mDestinations;          // Read destination per channel, preallocated for the audio thread
             int mBufferSize;
+
+            std::shared_ptr<ClockDriftController> mDriftController = nullptr;
+            std::vector<SampleValue> mResampleBuffer;   // Per channel: dequeued samples waiting to be resampled, starts with one sample of history
+            int mResampleStride = 0;                    // Distance between the channels in the resample buffer
+            int mResampleCount = 0;                     // Number of valid samples per channel in the resample buffer
+            double mReadPosition = 0.0;                 // Fractional read position in the resample buffer
+
+            int mTargetLatency = 0;                     // Target queue fill in samples per channel, 0 when disabled
+            int mCorrectionSize = 0;                    // Max number of samples skipped or repeated in a single block
+            bool mPrefilling = true;                    // Waiting for the queue to reach the target latency
+            double mSmoothedFill = 0.0;                 // Queue fill averaged over the last blocks
+            std::vector<SampleValue> mCorrectionBuffer; // Per channel: the samples of a block that is being corrected
+            std::atomic<float> mLatency = { 0.0f };     // Smoothed queue fill, readable from any thread
+
+            bool mConcealment = true;                   // Conceal gaps instead of playing silence
+            PacketLossConcealer mConcealer;             // Only used on the thread queueing samples
+            std::vector<float> mSilence;                // Silent input the concealment is crossfaded into
+
+            bool mSuspended = false;                    // Suspended by the sender, only used on the thread queueing samples
+            int mResumeLatency = 0;                     // Latency restored when the stream resumes
+            std::atomic<bool> mIdle = { false };        // Suspended, read on the audio thread
+
+            VBANCounter mUnderruns;                     // Incremented on the audio thread
+            VBANCounter mDroppedSamples;                // Incremented on the thread queueing samples
+            VBANCounter mConcealedSamples;              // Incremented on the thread queueing samples
+            VBANHistogram mQueueFill;                   // Recorded on the audio thread
+            VBANLatencyMonitor* mLatencyMonitor = nullptr;
 		};
 
 	}
@@ -0,0 +1,74 @@
+#include "vbancodec.h"
+#include "vbanpcmconvert.h"
+
+namespace nap
+{
+    namespace
+    {
+        template<VBanBitResolution Resolution>
+        void decodeFrames(const uint8_t* src, float* dst, int channelCount, int frameCount)
+        {
+            using Format = VBANSampleFormat<Resolution>;
+            for (int f = 0; f < frameCount; f++)
+            {
+                const uint8_t* frame = src + static_cast<size_t>(f) * channelCount * Format::sSize;
+                for (int c = 0; c < channelCount; c++)
+                    dst[static_cast<size_t>(c) * frameCount + f] = Format::decode(frame + c * Format::sSize);
+            }
+        }
+
+
+        template<VBanBitResolution Resolution>
+        void encodeFrames(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount)
+        {
+            using Format = VBANSampleFormat<Resolution>;
+            for (int f = 0; f < frameCount; f++)
+            {
+                uint8_t* frame = dst + static_cast<size_t>(f) * channelCount * Format::sSize;
+                for (int c = 0; c < channelCount; c++)
+                    Format::encode(src[c][srcOffset + f], frame + c * Format::sSize);
+            }
+        }
+
+
+        // 16 bit is the most common format and uses the vectorized kernels
+        template<>
+        void decodeFrames<VBAN_BITFMT_16_INT>(const uint8_t* src, float* dst, int channelCount, int frameCount)
+        {
+            utility::decodePCM16(src, dst, channelCount, frameCount);
+        }
+
+
+        template<>
+        void encodeFrames<VBAN_BITFMT_16_INT>(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount)
+        {
+            utility::encodePCM16(src, srcOffset, dst, channelCount, frameCount);
+        }
+
+
+        template<VBanBitResolution Resolution>
+        constexpr VBANCodec makeCodec()
+        {
+            return { Resolution, VBANSampleFormat<Resolution>::sSize, &decodeFrames<Resolution>, &encodeFrames<Resolution> };
+        }
+
+
+        // Indexed by VBanBitResolution, 12 and 10 bit formats are not supported
+        const VBANCodec sCodecs[] =
+        {
+            makeCodec<VBAN_BITFMT_8_INT>(),
+            makeCodec<VBAN_BITFMT_16_INT>(),
+            makeCodec<VBAN_BITFMT_24_INT>(),
+            makeCodec<VBAN_BITFMT_32_INT>(),
+            makeCodec<VBAN_BITFMT_32_FLOAT>(),
+            makeCodec<VBAN_BITFMT_64_FLOAT>()
+        };
+    }
+
+
+    const VBANCodec* utility::getVBANCodec(VBanBitResolution resolution)
+    {
+        auto index = static_cast<size_t>(resolution);
+        return index < sizeof(sCodecs) / sizeof(sCodecs[0]) ? &sCodecs[index] : nullptr;
+    }
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+// Std includes
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include "vban/vban.h"
+
+namespace nap
+{
+    /**
+     * PCM bit resolutions supported by the VBAN sender and receiver
+     */
+    enum class EVBANBitResolution : int
+    {
+        Int8    = VBAN_BITFMT_8_INT,        ///< 8 bit unsigned integer, 128 is zero
+        Int16   = VBAN_BITFMT_16_INT,       ///< 16 bit signed integer
+        Int24   = VBAN_BITFMT_24_INT,       ///< 24 bit signed integer
+        Int32   = VBAN_BITFMT_32_INT,       ///< 32 bit signed integer
+        Float32 = VBAN_BITFMT_32_FLOAT,     ///< 32 bit floating point, no quantization
+        Float64 = VBAN_BITFMT_64_FLOAT      ///< 64 bit floating point
+    };
+
+
+    /**
+     * Compile time description of a VBAN PCM sample format.
+     * Specialized for every supported VBanBitResolution, samples are always stored little endian.
+     * Integer formats are rounded to the nearest value and saturated when encoding.
+     */
+    template<VBanBitResolution Resolution>
+    struct VBANSampleFormat;
+
+
+    template<>
+    struct VBANSampleFormat<VBAN_BITFMT_8_INT>
+    {
+        static constexpr int sSize = 1;
+        // unsigned, 128 is zero
+        static float decode(const uint8_t* src) { return static_cast<float>(static_cast<int>(src[0]) - 128) * (1.0f / 128.0f); }
+        static void encode(float sample, uint8_t* dst)
+        {
+            float scaled = sample * 128.0f;
+            scaled = scaled < -128.0f ? -128.0f : (scaled > 127.0f ? 127.0f : scaled);
+            dst[0] = static_cast<uint8_t>(lrintf(scaled) + 128);
+        }
+    };
+
+
+    template<>
+    struct VBANSampleFormat<VBAN_BITFMT_16_INT>
+    {
+        static constexpr int sSize = 2;
+        static float decode(const uint8_t* src)
+        {
+            return static_cast<float>(static_cast<int16_t>(static_cast<uint16_t>(src[0]) | (static_cast<uint16_t>(src[1]) << 8))) * (1.0f / 32768.0f);
+        }
+        static void encode(float sample, uint8_t* dst)
+        {
+            float scaled = sample * 32768.0f;
+            scaled = scaled < -32768.0f ? -32768.0f : (scaled > 32767.0f ? 32767.0f : scaled);
+            auto value = static_cast<uint16_t>(static_cast<int16_t>(lrintf(scaled)));
+            dst[0] = static_cast<uint8_t>(value);
+            dst[1] = static_cast<uint8_t>(value >> 8);
+        }
+    };
+
+
+    template<>
+    struct VBANSampleFormat<VBAN_BITFMT_24_INT>
+    {
+        static constexpr int sSize = 3;
+        static float decode(const uint8_t* src)
+        {
+            // place the 24 bits in the top of a 32 bit word and shift back to sign extend
+            uint32_t bits = (static_cast<uint32_t>(src[0]) << 8) | (static_cast<uint32_t>(src[1]) << 16) | (static_cast<uint32_t>(src[2]) << 24);
+            return static_cast<float>(static_cast<int32_t>(bits) >> 8) * (1.0f / 8388608.0f);
+        }
+        static void encode(float sample, uint8_t* dst)
+        {
+            float scaled = sample * 8388608.0f;
+            scaled = scaled < -8388608.0f ? -8388608.0f : (scaled > 8388607.0f ? 8388607.0f : scaled);
+            auto value = static_cast<uint32_t>(static_cast<int32_t>(lrintf(scaled)));
+            dst[0] = static_cast<uint8_t>(value);
+            dst[1] = static_cast<uint8_t>(value >> 8);
+            dst[2] = static_cast<uint8_t>(value >> 16);
+        }
+    };
+
+
+    template<>
+    struct VBANSampleFormat<VBAN_BITFMT_32_INT>
+    {
+        static constexpr int sSize = 4;
+        static float decode(const uint8_t* src)
+        {
+            uint32_t bits = static_cast<uint32_t>(src[0]) | (static_cast<uint32_t>(src[1]) << 8) | (static_cast<uint32_t>(src[2]) << 16) | (static_cast<uint32_t>(src[3]) << 24);
+            return static_cast<float>(static_cast<double>(static_cast<int32_t>(bits)) * (1.0 / 2147483648.0));
+        }
+        static void encode(float sample, uint8_t* dst)
+        {
+            // float can not represent the full 32 bit range, scale in double precision
+            double scaled = static_cast<double>(sample) * 2147483648.0;
+            scaled = scaled < -2147483648.0 ? -2147483648.0 : (scaled > 2147483647.0 ? 2147483647.0 : scaled);
+            auto value = static_cast<uint32_t>(static_cast<int32_t>(llrint(scaled)));
+            dst[0] = static_cast<uint8_t>(value);
+            dst[1] = static_cast<uint8_t>(value >> 8);
+            dst[2] = static_cast<uint8_t>(value >> 16);
+            dst[3] = static_cast<uint8_t>(value >> 24);
+        }
+    };
+
+
+    template<>
+    struct VBANSampleFormat<VBAN_BITFMT_32_FLOAT>
+    {
+        static constexpr int sSize = 4;
+        static float decode(const uint8_t* src)
+        {
+            uint32_t bits = static_cast<uint32_t>(src[0]) | (static_cast<uint32_t>(src[1]) << 8) | (static_cast<uint32_t>(src[2]) << 16) | (static_cast<uint32_t>(src[3]) << 24);
+            float value;
+            memcpy(&value, &bits, sizeof(float));
+            return value;
+        }
+        static void encode(float sample, uint8_t* dst)
+        {
+            uint32_t bits;
+            memcpy(&bits, &sample, sizeof(float));
+            for (int i = 0; i < 4; i++)
+                dst[i] = static_cast<uint8_t>(bits >> (i * 8));
+        }
+    };
+
+
+    template<>
+    struct VBANSampleFormat<VBAN_BITFMT_64_FLOAT>
+    {
+        static constexpr int sSize = 8;
+        static float decode(const uint8_t* src)
+        {
+            uint64_t bits = 0;
+            for (int i = 0; i < 8; i++)
+                bits |= static_cast<uint64_t>(src[i]) << (i * 8);
+            double value;
+            memcpy(&value, &bits, sizeof(double));
+            return static_cast<float>(value);
+        }
+        static void encode(float sample, uint8_t* dst)
+        {
+            double value = sample;
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(double));
+            for (int i = 0; i < 8; i++)
+                dst[i] = static_cast<uint8_t>(bits >> (i * 8));
+        }
+    };
+
+
+    /**
+     * Converts a block of PCM samples of one bit resolution from and to planar floating point data.
+     * Obtain the codec for a bit resolution using utility::getVBANCodec().
+     */
+    struct VBANCodec
+    {
+        using DecodeFunction = void(*)(const uint8_t* src, float* dst, int channelCount, int frameCount);
+        using EncodeFunction = void(*)(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount);
+
+        VBanBitResolution mResolution;  ///< The bit resolution handled by this codec
+        int mSampleSize;                ///< Size of a single sample in bytes
+        DecodeFunction mDecode;         ///< Interleaved PCM to planar float, see utility::decodePCM16 for the layout
+        EncodeFunction mEncode;         ///< Planar float to interleaved PCM, see utility::encodePCM16 for the layout
+    };
+
+
+    namespace utility
+    {
+        /**
+         * Returns the codec for the given bit resolution
+         * @param resolution the bit resolution
+         * @return the codec, nullptr when the resolution is not supported
+         */
+        const VBANCodec* getVBANCodec(VBanBitResolution resolution);
+    }
+}
@@ -0,0 +1,179 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "vbanjitterbuffer.h"
+
+// Std includes
+#include <algorithm>
+#include <cstring>
+
+namespace nap
+{
+    // Packets further than this away from the expected frame counter restart the sequence, for example when the sender restarts
+    static constexpr int32_t sResyncDistance = 256;
+
+
+    void VBANJitterBuffer::init(int windowSize, int channelCount)
+    {
+        mChannelCount = channelCount;
+        mSlots.resize(std::max(windowSize, 1));
+        for (auto& slot : mSlots)
+            slot.mData.resize(static_cast<size_t>(channelCount) * VBAN_SAMPLES_MAX_NB);
+        reset();
+    }
+
+
+    void VBANJitterBuffer::push(const VBANBufferView& buffers, IOutput& output)
+    {
+        assert(!mSlots.empty());
+        uint32_t const frame = buffers.mFrameCounter;
+        if (!buffers.mSilence)
+            mLastFrameCount = buffers.mFrameCount;
+
+        // first packet starts the sequence
+        if (!mStarted)
+        {
+            mStarted = true;
+            mNextFrame = frame;
+        }
+
+        // distance to the expected packet, wraps around with the frame counter
+        int32_t distance = static_cast<int32_t>(frame - mNextFrame);
+        if (distance <= -sResyncDistance || distance >= sResyncDistance)
+        {
+            mResyncs.add();
+            flush(output);
+            mNextFrame = frame;
+            distance = 0;
+        }
+
+        // late or duplicate packet, its position has already been played out
+        if (distance < 0)
+        {
+            mLate.add();
+            return;
+        }
+
+        // make room in the window, packets that did not arrive in time are reported as gaps
+        int32_t const window_size = static_cast<int32_t>(mSlots.size());
+        while (static_cast<int32_t>(frame - mNextFrame) >= window_size)
+            releaseNext(output);
+
+        if (frame == mNextFrame)
+        {
+            mReleased.add();
+            output.framesReleased(buffers);
+            mNextFrame++;
+            releaseStored(output);
+        }
+        else
+        {
+            // hold back until the missing packets arrive, unless it is a duplicate of a held back packet
+            Slot& slot = getSlot(frame);
+            if (slot.mUsed && slot.mFrameCounter == frame)
+            {
+                mDuplicates.add();
+            }
+            else
+            {
+                mReordered.add();
+                store(buffers);
+            }
+        }
+    }
+
+
+    void VBANJitterBuffer::reset()
+    {
+        for (auto& slot : mSlots)
+            slot.mUsed = false;
+        mStarted = false;
+    }
+
+
+    void VBANJitterBuffer::store(const VBANBufferView& buffers)
+    {
+        Slot& slot = getSlot(buffers.mFrameCounter);
+        slot.mUsed = true;
+        slot.mFrameCounter = buffers.mFrameCounter;
+        slot.mFrameCount = buffers.mFrameCount;
+        slot.mSampleRate = buffers.mSampleRate;
+        slot.mReceiveTime = buffers.mReceiveTime;
+        slot.mSilence = buffers.mSilence;
+
+        // channels are stored contiguously, same as the view
+        int const channel_count = std::min(buffers.mChannelCount, mChannelCount);
+        std::memcpy(slot.mData.data(), buffers.mData, static_cast<size_t>(channel_count) * buffers.mFrameCount * sizeof(float));
+    }
+
+
+    void VBANJitterBuffer::releaseSlot(Slot& slot, IOutput& output)
+    {
+        VBANBufferView view;
+        view.mData = slot.mData.data();
+        view.mChannelCount = mChannelCount;
+        view.mFrameCount = slot.mFrameCount;
+        view.mFrameCounter = slot.mFrameCounter;
+        view.mSampleRate = slot.mSampleRate;
+        view.mReceiveTime = slot.mReceiveTime;
+        view.mSilence = slot.mSilence;
+
+        slot.mUsed = false;
+        mReleased.add();
+        output.framesReleased(view);
+    }
+
+
+    void VBANJitterBuffer::releaseNext(IOutput& output)
+    {
+        Slot& slot = getSlot(mNextFrame);
+        if (slot.mUsed && slot.mFrameCounter == mNextFrame)
+            releaseSlot(slot, output);
+        else
+        {
+            mLost.add();
+            output.gapDetected(mLastFrameCount);
+        }
+        mNextFrame++;
+    }
+
+
+    void VBANJitterBuffer::releaseStored(IOutput& output)
+    {
+        while (true)
+        {
+            Slot& slot = getSlot(mNextFrame);
+            if (!slot.mUsed || slot.mFrameCounter != mNextFrame)
+                break;
+            releaseSlot(slot, output);
+            mNextFrame++;
+        }
+    }
+
+
+    void VBANJitterBuffer::flush(IOutput& output)
+    {
+        // release what is held back in order, without reporting gaps
+        uint32_t const end = mNextFrame + static_cast<uint32_t>(mSlots.size());
+        for (uint32_t frame = mNextFrame; frame != end; frame++)
+        {
+            Slot& slot = getSlot(frame);
+            if (slot.mUsed && slot.mFrameCounter == frame)
+                releaseSlot(slot, output);
+        }
+        reset();
+        mStarted = true;
+    }
+
+
+    void VBANJitterBuffer::getStatistics(VBANPlayoutStatistics& statistics) const
+    {
+        statistics.mPacketsReleased = mReleased.get();
+        statistics.mPacketsLost = mLost.get();
+        statistics.mPacketsReordered = mReordered.get();
+        statistics.mPacketsDuplicate = mDuplicates.get();
+        statistics.mPacketsLate = mLate.get();
+        statistics.mResyncs = mResyncs.get();
+    }
+}
@@ -0,0 +1,105 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Vban includes
+#include "vbanpacketreceiver.h"
+#include "vbanstatistics.h"
+
+// Std includes
+#include <vector>
+
+namespace nap
+{
+    /**
+     * Restores the order of the packets of a single VBAN stream using the frame counter (nuFrame) in the packet header.
+     * Packets that arrive ahead of a missing packet are held back until the missing packet arrives or until the
+     * reorder window is exceeded, in which case the missing packet is reported as a gap.
+     * Duplicate packets and packets that arrive after their position has been played out are discarded.
+     * All storage is allocated on init, pushing packets does not allocate.
+     * Not thread safe, push packets from a single thread. The statistics can be read from any thread.
+     */
+    class NAPAPI VBANJitterBuffer
+    {
+    public:
+        /**
+         * Receives the packets of the stream in order
+         */
+        class NAPAPI IOutput
+        {
+        public:
+            virtual ~IOutput() = default;
+
+            /**
+             * Called for every packet that is released in order
+             * @param buffers the packet data, only valid for the duration of the call
+             */
+            virtual void framesReleased(const VBANBufferView& buffers) = 0;
+
+            /**
+             * Called for every packet that is considered lost
+             * @param frameCount number of samples per channel that are missing
+             */
+            virtual void gapDetected(int frameCount) = 0;
+        };
+
+        /**
+         * Allocates storage for the reorder window
+         * @param windowSize the number of packets a missing packet is waited for, 1 disables reordering
+         * @param channelCount the number of channels to store of every packet
+         */
+        void init(int windowSize, int channelCount);
+
+        /**
+         * Inserts a packet, releases all packets that are in order to the output
+         * @param buffers the packet, frames beyond the channel count given on init are ignored
+         * @param output receives the packets that are released and the gaps that are detected
+         */
+        void push(const VBANBufferView& buffers, IOutput& output);
+
+        /**
+         * Discards all held back packets and waits for the next packet to start a new sequence
+         */
+        void reset();
+
+        /**
+         * Copies the packet counters of the jitter buffer into the given statistics, can be called from any thread
+         * @param statistics receives the released, lost, reordered, duplicate, late and resync counts
+         */
+        void getStatistics(VBANPlayoutStatistics& statistics) const;
+
+    private:
+        struct Slot
+        {
+            bool mUsed = false;
+            uint32_t mFrameCounter = 0;
+            int mFrameCount = 0;
+            int mSampleRate = 0;
+            int64_t mReceiveTime = 0;
+            bool mSilence = false;
+            std::vector<float> mData;
+        };
+
+        void store(const VBANBufferView& buffers);
+        void releaseSlot(Slot& slot, IOutput& output);
+        void releaseNext(IOutput& output);
+        void releaseStored(IOutput& output);
+        void flush(IOutput& output);
+        Slot& getSlot(uint32_t frameCounter) { return mSlots[frameCounter % mSlots.size()]; }
+
+        std::vector<Slot> mSlots;
+        int mChannelCount = 0;
+        bool mStarted = false;
+        uint32_t mNextFrame = 0;        // frame counter of the next packet to release
+        int mLastFrameCount = 0;        // samples per channel of the last packet with samples, used to size gaps
+
+        VBANCounter mReleased;
+        VBANCounter mLost;
+        VBANCounter mReordered;
+        VBANCounter mDuplicates;
+        VBANCounter mLate;
+        VBANCounter mResyncs;
+    };
+}
@@ -0,0 +1,138 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "vbanlatencymonitor.h"
+#include "vbanpacketqueue.h"
+
+// Std includes
+#include <algorithm>
+
+RTTI_BEGIN_CLASS(nap::VBANLatencyMonitor)
+RTTI_PROPERTY("HistorySize", &nap::VBANLatencyMonitor::mHistorySize, nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+namespace nap
+{
+    // Computes the distribution of a stage in milliseconds, sorts the values
+    static void computeStage(std::vector<int64_t>& values, VBANLatencyReport::Stage& stage)
+    {
+        stage = VBANLatencyReport::Stage();
+        if (values.empty())
+            return;
+
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (auto value : values)
+            sum += static_cast<double>(value);
+
+        auto toMilliseconds = [](double nanoseconds) { return static_cast<float>(nanoseconds * 1e-6); };
+        auto percentile = [&values](double fraction) { return values[static_cast<size_t>(fraction * (values.size() - 1) + 0.5)]; };
+        stage.mMin = toMilliseconds(values.front());
+        stage.mMean = toMilliseconds(sum / values.size());
+        stage.mMedian = toMilliseconds(percentile(0.5));
+        stage.mP95 = toMilliseconds(percentile(0.95));
+        stage.mMax = toMilliseconds(values.back());
+    }
+
+
+    bool VBANLatencyMonitor::init(utility::ErrorState& errorState)
+    {
+        if (!errorState.check(mHistorySize > 0, "%s: HistorySize must be 1 or larger", mID.c_str()))
+            return false;
+
+        mFrames = std::vector<Frame>(static_cast<size_t>(mHistorySize));
+        mMarks.assign(static_cast<size_t>(mHistorySize), Mark());
+        return true;
+    }
+
+
+    void VBANLatencyMonitor::packetSent(uint32_t frameCounter, int64_t encodeTime)
+    {
+        // the sender is the first to see a frame, it claims the entry of an older frame
+        Frame& frame = getFrame(frameCounter);
+        frame.mFrameCounter.store(frameCounter, std::memory_order_relaxed);
+        frame.mReceiveTime.store(0, std::memory_order_relaxed);
+        frame.mPlayTime.store(0, std::memory_order_relaxed);
+        frame.mOutputTime.store(0, std::memory_order_relaxed);
+        frame.mEncodeTime.store(encodeTime, std::memory_order_relaxed);
+        frame.mSendTime.store(VBANPacketQueue::getClockTime(), std::memory_order_release);
+    }
+
+
+    void VBANLatencyMonitor::packetQueued(uint32_t frameCounter, int64_t receiveTime, uint64_t queuePosition)
+    {
+        Frame& frame = getFrame(frameCounter);
+        if (frame.mFrameCounter.load(std::memory_order_acquire) != frameCounter)
+            return;
+        frame.mReceiveTime.store(receiveTime, std::memory_order_relaxed);
+
+        // hand the position to the player, the frame is not timed when the ring is full
+        uint64_t const write_index = mMarkWriteIndex.load(std::memory_order_relaxed);
+        if (write_index - mMarkReadIndex.load(std::memory_order_acquire) >= mMarks.size())
+            return;
+        mMarks[write_index % mMarks.size()] = { frameCounter, queuePosition };
+        mMarkWriteIndex.store(write_index + 1, std::memory_order_release);
+    }
+
+
+    void VBANLatencyMonitor::samplesPlayed(uint64_t readStart, uint64_t readEnd, int bufferSize, float sampleRate)
+    {
+        int64_t const now = VBANPacketQueue::getClockTime();
+        double const frame_duration = 1e9 / sampleRate;
+
+        // every frame whose first sample was read in this block leaves the device after the samples before it in
+        // the block, once the block itself is played, one audio buffer after it is processed
+        uint64_t read_index = mMarkReadIndex.load(std::memory_order_relaxed);
+        uint64_t const write_index = mMarkWriteIndex.load(std::memory_order_acquire);
+        for (; read_index != write_index; read_index++)
+        {
+            const Mark& mark = mMarks[read_index % mMarks.size()];
+            if (mark.mPosition >= readEnd)
+                break;
+
+            Frame& frame = getFrame(mark.mFrameCounter);
+            if (frame.mFrameCounter.load(std::memory_order_acquire) != mark.mFrameCounter)
+                continue;
+
+            uint64_t const offset = mark.mPosition > readStart ? mark.mPosition - readStart : 0;
+            frame.mPlayTime.store(now, std::memory_order_relaxed);
+            frame.mOutputTime.store(now + static_cast<int64_t>((bufferSize + offset) * frame_duration), std::memory_order_release);
+        }
+        mMarkReadIndex.store(read_index, std::memory_order_release);
+    }
+
+
+    void VBANLatencyMonitor::getReport(VBANLatencyReport& report) const
+    {
+        std::vector<int64_t> packetization, network, queueing, playout, total;
+        for (const auto& frame : mFrames)
+        {
+            uint32_t const frame_counter = frame.mFrameCounter.load(std::memory_order_acquire);
+            int64_t const output_time = frame.mOutputTime.load(std::memory_order_acquire);
+            int64_t const encode_time = frame.mEncodeTime.load(std::memory_order_relaxed);
+            int64_t const send_time = frame.mSendTime.load(std::memory_order_relaxed);
+            int64_t const receive_time = frame.mReceiveTime.load(std::memory_order_relaxed);
+            int64_t const play_time = frame.mPlayTime.load(std::memory_order_relaxed);
+
+            // incomplete, or overwritten by a newer frame while reading
+            if (encode_time == 0 || send_time == 0 || receive_time == 0 || play_time == 0 || output_time == 0)
+                continue;
+            if (frame.mFrameCounter.load(std::memory_order_acquire) != frame_counter)
+                continue;
+
+            packetization.emplace_back(send_time - encode_time);
+            network.emplace_back(receive_time - send_time);
+            queueing.emplace_back(play_time - receive_time);
+            playout.emplace_back(output_time - play_time);
+            total.emplace_back(output_time - encode_time);
+        }
+
+        report.mFrameCount = static_cast<int>(total.size());
+        computeStage(packetization, report.mPacketization);
+        computeStage(network, report.mNetwork);
+        computeStage(queueing, report.mQueueing);
+        computeStage(playout, report.mPlayout);
+        computeStage(total, report.mTotal);
+    }
+}
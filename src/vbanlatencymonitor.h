@@ -0,0 +1,108 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Nap includes
+#include <nap/resource.h>
+
+// Vban includes
+#include "vbanstatistics.h"
+
+// Std includes
+#include <atomic>
+#include <vector>
+
+namespace nap
+{
+    /**
+     * Measures the latency a VBAN stream adds, from the moment a sample is encoded by the VBANSenderNode until it is
+     * played by the SampleQueuePlayerNode, split into stages. Meant for measurements over loopback, with the sender and
+     * the player of the same stream in one application: point the 'LatencyMonitor' property of both the
+     * VBANStreamSenderComponent and the VBANStreamPlayerComponent to the same monitor.
+     *
+     * Every frame (nuFrame) is time stamped when its first sample is encoded, when the packet is queued for sending,
+     * when it is received, when it is queued for playout and when its first sample is read by the player.
+     * All times are taken from the clock of VBANPacketQueue::getClockTime(). The receive time is the kernel time stamp
+     * of the socket when the VBANUDPServer has 'Timestamps' enabled, otherwise the time the packet was read from the socket.
+     * Recording is lock free and does not allocate, the report is computed from the last 'HistorySize' frames.
+     */
+    class NAPAPI VBANLatencyMonitor : public Resource
+    {
+        RTTI_ENABLE(Resource)
+    public:
+        /**
+         * Allocates the frame history
+         * @param errorState contains any errors
+         * @return true on success
+         */
+        bool init(utility::ErrorState& errorState) override;
+
+        /**
+         * Records a packet that is queued for sending, call from the audio thread of the sender
+         * @param frameCounter the frame counter of the packet
+         * @param encodeTime time the first sample of the packet was encoded
+         */
+        void packetSent(uint32_t frameCounter, int64_t encodeTime);
+
+        /**
+         * Records a received packet that is queued for playout, call from the thread queueing samples of the player
+         * @param frameCounter the frame counter of the packet
+         * @param receiveTime time the packet was received
+         * @param queuePosition position in the playout queue of the first sample, see SampleQueuePlayerNode::getWritePosition()
+         */
+        void packetQueued(uint32_t frameCounter, int64_t receiveTime, uint64_t queuePosition);
+
+        /**
+         * Records the samples read by the player in an audio block, call from the audio thread of the player
+         * @param readStart position in the playout queue of the first sample read in the block
+         * @param readEnd position in the playout queue after the last sample read in the block
+         * @param bufferSize the audio buffer size
+         * @param sampleRate sample rate of the audio engine
+         */
+        void samplesPlayed(uint64_t readStart, uint64_t readEnd, int bufferSize, float sampleRate);
+
+        /**
+         * Computes the latency distribution of every stage over the recorded frames, call from the main thread.
+         * Frames are recorded concurrently, frames that are overwritten while the report is computed are skipped.
+         * @param report receives the distributions
+         */
+        void getReport(VBANLatencyReport& report) const;
+
+        int mHistorySize = 1024;        ///< Property: 'HistorySize' number of most recent frames the report is computed from
+
+    private:
+        /**
+         * Time stamps of a single frame, a time of 0 is not recorded yet
+         */
+        struct Frame
+        {
+            std::atomic<uint32_t> mFrameCounter = { 0 };
+            std::atomic<int64_t> mEncodeTime = { 0 };
+            std::atomic<int64_t> mSendTime = { 0 };
+            std::atomic<int64_t> mReceiveTime = { 0 };
+            std::atomic<int64_t> mPlayTime = { 0 };
+            std::atomic<int64_t> mOutputTime = { 0 };
+        };
+
+        /**
+         * Position of a queued frame in the playout queue, handed from the receiving to the playing thread
+         */
+        struct Mark
+        {
+            uint32_t mFrameCounter = 0;
+            uint64_t mPosition = 0;
+        };
+
+        Frame& getFrame(uint32_t frameCounter) { return mFrames[frameCounter % mFrames.size()]; }
+        const Frame& getFrame(uint32_t frameCounter) const { return mFrames[frameCounter % mFrames.size()]; }
+
+        std::vector<Frame> mFrames;
+
+        // Single producer, single consumer ring of frames waiting to be played
+        std::vector<Mark> mMarks;
+        alignas(64) std::atomic<uint64_t> mMarkWriteIndex = { 0 };
+        alignas(64) std::atomic<uint64_t> mMarkReadIndex = { 0 };
+    };
+}
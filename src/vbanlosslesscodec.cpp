@@ -0,0 +1,406 @@
+#include "vbanlosslesscodec.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace nap
+{
+    namespace
+    {
+        // First byte of a compressed payload, tells it apart from payloads of other user codecs
+        constexpr uint8_t sTag = 0x4C;
+
+        // Highest order of the fixed predictors
+        constexpr int sMaxOrder = 4;
+
+        // Highest Rice parameter, stored in 5 bits
+        constexpr int sMaxRiceParameter = 31;
+
+
+        int getSampleSize(VBanBitResolution resolution)
+        {
+            switch (resolution)
+            {
+            case VBAN_BITFMT_8_INT:     return 1;
+            case VBAN_BITFMT_16_INT:    return 2;
+            case VBAN_BITFMT_24_INT:    return 3;
+            default:                    return 0;
+            }
+        }
+
+
+        int countLeadingZeros(uint64_t value)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanReverse64(&index, value);
+            return 63 - static_cast<int>(index);
+#else
+            return __builtin_clzll(value);
+#endif
+        }
+
+
+        // Reads the samples of a single channel from interleaved PCM, 8 bit samples are converted to signed
+        template<int SampleSize>
+        void readChannel(const uint8_t* src, int channel, int channelCount, int frameCount, int32_t* dst)
+        {
+            const uint8_t* sample = src + static_cast<size_t>(channel) * SampleSize;
+            size_t const stride = static_cast<size_t>(channelCount) * SampleSize;
+            for (int i = 0; i < frameCount; i++, sample += stride)
+            {
+                if (SampleSize == 1)
+                    dst[i] = static_cast<int32_t>(sample[0]) - 128;
+                else if (SampleSize == 2)
+                    dst[i] = static_cast<int16_t>(static_cast<uint16_t>(sample[0] | (sample[1] << 8)));
+                else
+                    dst[i] = static_cast<int32_t>((static_cast<uint32_t>(sample[0]) << 8) | (static_cast<uint32_t>(sample[1]) << 16) | (static_cast<uint32_t>(sample[2]) << 24)) >> 8;
+            }
+        }
+
+
+        // Writes the samples of a single channel to interleaved PCM
+        void writeChannel(const int32_t* src, int channel, int channelCount, int frameCount, int sampleSize, uint8_t* dst)
+        {
+            uint8_t* sample = dst + static_cast<size_t>(channel) * sampleSize;
+            size_t const stride = static_cast<size_t>(channelCount) * sampleSize;
+            for (int i = 0; i < frameCount; i++, sample += stride)
+            {
+                // 8 bit samples are unsigned, 128 is zero
+                auto const value = static_cast<uint32_t>(sampleSize == 1 ? src[i] + 128 : src[i]);
+                for (int b = 0; b < sampleSize; b++)
+                    sample[b] = static_cast<uint8_t>(value >> (b * 8));
+            }
+        }
+
+
+        // Fixed polynomial prediction of sample i from the samples before it
+        template<int Order>
+        int32_t predict(const int32_t* x, int i)
+        {
+            switch (Order)
+            {
+            case 0:     return 0;
+            case 1:     return x[i - 1];
+            case 2:     return 2 * x[i - 1] - x[i - 2];
+            case 3:     return 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3];
+            default:    return 4 * x[i - 1] - 6 * x[i - 2] + 4 * x[i - 3] - x[i - 4];
+            }
+        }
+
+
+        /**
+         * Big endian bit stream writer, stops writing when the capacity is exceeded
+         */
+        class BitWriter
+        {
+        public:
+            BitWriter(uint8_t* data, size_t capacity) : mData(data), mCapacity(capacity) { }
+
+            // Writes the lowest bits of value, at most 32
+            void write(uint32_t value, int bits)
+            {
+                mCache = (mCache << bits) | (bits == 32 ? value : value & ((1u << bits) - 1));
+                mCount += bits;
+                while (mCount >= 8)
+                {
+                    mCount -= 8;
+                    if (mPosition == mCapacity)
+                    {
+                        mOverflow = true;
+                        return;
+                    }
+                    mData[mPosition++] = static_cast<uint8_t>(mCache >> mCount);
+                }
+            }
+
+            // Writes the quotient in unary as zeros terminated by a one, followed by the lowest k bits of the value
+            void writeRice(uint32_t value, int k)
+            {
+                uint32_t quotient = value >> k;
+                if (static_cast<uint64_t>(quotient) + 1 + k > getRemainingBits())
+                {
+                    mOverflow = true;
+                    return;
+                }
+                uint32_t const code = (1u << k) | (value & ((1u << k) - 1));
+                if (quotient + k < 32)
+                {
+                    // common case, the zeros and the code fit in a single write
+                    write(code, static_cast<int>(quotient) + k + 1);
+                    return;
+                }
+                for (; quotient >= 32; quotient -= 32)
+                    write(0, 32);
+                write(0, static_cast<int>(quotient));
+                write(code, k + 1);
+            }
+
+            // Pads the last byte with zeros
+            void flush()
+            {
+                if (mCount > 0)
+                    write(0, 8 - mCount);
+            }
+
+            size_t getSize() const { return mPosition; }
+            bool hasOverflow() const { return mOverflow; }
+
+        private:
+            uint64_t getRemainingBits() const { return mOverflow ? 0 : static_cast<uint64_t>(mCapacity - mPosition) * 8 - mCount; }
+
+            uint8_t* mData;
+            size_t mCapacity;
+            size_t mPosition = 0;
+            uint64_t mCache = 0;
+            int mCount = 0;
+            bool mOverflow = false;
+        };
+
+
+        /**
+         * Big endian bit stream reader, reads zeros past the end and remembers it did
+         */
+        class BitReader
+        {
+        public:
+            BitReader(const uint8_t* data, size_t size) : mData(data), mSize(size) { }
+
+            // Reads at most 32 bits
+            uint32_t read(int bits)
+            {
+                if (bits == 0)
+                    return 0;
+                refill();
+                auto const value = static_cast<uint32_t>(mCache >> (64 - bits));
+                consume(bits);
+                return value;
+            }
+
+            // Reads a unary coded quotient, bounded by the size of the stream
+            uint32_t readUnary()
+            {
+                uint32_t quotient = 0;
+                while (!hasOverrun())
+                {
+                    refill();
+                    int const zeros = mCache != 0 ? countLeadingZeros(mCache) : 64;
+                    if (zeros < mCount)
+                    {
+                        consume(zeros + 1);
+                        return quotient + static_cast<uint32_t>(zeros);
+                    }
+                    quotient += static_cast<uint32_t>(mCount);
+                    consume(mCount);
+                }
+                return 0;
+            }
+
+            bool hasOverrun() const { return mConsumed > static_cast<uint64_t>(mSize) * 8; }
+
+        private:
+            // Keeps the next bits in the top of the cache, at least 57 of them
+            void refill()
+            {
+                for (; mCount <= 56; mCount += 8)
+                {
+                    uint64_t const byte = mPosition < mSize ? mData[mPosition] : 0;
+                    mPosition++;
+                    mCache |= byte << (56 - mCount);
+                }
+            }
+
+            void consume(int bits)
+            {
+                mCache = bits < 64 ? mCache << bits : 0;
+                mCount -= bits;
+                mConsumed += static_cast<uint64_t>(bits);
+            }
+
+            const uint8_t* mData;
+            size_t mSize;
+            size_t mPosition = 0;
+            uint64_t mCache = 0;
+            int mCount = 0;
+            uint64_t mConsumed = 0;
+        };
+
+
+        // Picks the fixed predictor with the smallest sum of absolute residuals, returns that sum
+        int choosePredictor(const int32_t* x, int frameCount, uint64_t& sum)
+        {
+            // with too few samples the warm up of a higher order costs more than it saves
+            if (frameCount <= sMaxOrder)
+            {
+                sum = 0;
+                for (int i = 0; i < frameCount; i++)
+                    sum += static_cast<uint64_t>(x[i] < 0 ? -static_cast<int64_t>(x[i]) : x[i]);
+                return 0;
+            }
+
+            // residuals of all orders are successive differences of the signal
+            uint64_t sums[sMaxOrder + 1] = { 0, 0, 0, 0, 0 };
+            int32_t last0 = x[3];
+            int32_t last1 = x[3] - x[2];
+            int32_t last2 = last1 - (x[2] - x[1]);
+            int32_t last3 = last2 - (x[2] - x[1] - (x[1] - x[0]));
+            for (int i = sMaxOrder; i < frameCount; i++)
+            {
+                int32_t const e0 = x[i];
+                int32_t const e1 = e0 - last0;
+                int32_t const e2 = e1 - last1;
+                int32_t const e3 = e2 - last2;
+                int32_t const e4 = e3 - last3;
+                sums[0] += static_cast<uint32_t>(e0 < 0 ? -e0 : e0);
+                sums[1] += static_cast<uint32_t>(e1 < 0 ? -e1 : e1);
+                sums[2] += static_cast<uint32_t>(e2 < 0 ? -e2 : e2);
+                sums[3] += static_cast<uint32_t>(e3 < 0 ? -e3 : e3);
+                sums[4] += static_cast<uint32_t>(e4 < 0 ? -e4 : e4);
+                last0 = e0;
+                last1 = e1;
+                last2 = e2;
+                last3 = e3;
+            }
+
+            int order = 0;
+            for (int i = 1; i <= sMaxOrder; i++)
+                order = sums[i] < sums[order] ? i : order;
+            sum = sums[order];
+            return order;
+        }
+
+
+        // Rice parameter close to log2 of the mean folded residual
+        int chooseRiceParameter(uint64_t sum, int count)
+        {
+            if (count <= 0)
+                return 0;
+            uint64_t const folded_sum = 2 * sum;
+            int k = 0;
+            while (k < sMaxRiceParameter && (static_cast<uint64_t>(count) << (k + 1)) <= folded_sum)
+                k++;
+            return k;
+        }
+
+
+        template<int Order>
+        void encodeResiduals(const int32_t* x, int frameCount, int k, BitWriter& writer)
+        {
+            for (int i = Order; i < frameCount && !writer.hasOverflow(); i++)
+            {
+                int32_t const residual = x[i] - predict<Order>(x, i);
+                uint32_t const folded = (static_cast<uint32_t>(residual) << 1) ^ static_cast<uint32_t>(residual >> 31);
+                writer.writeRice(folded, k);
+            }
+        }
+
+
+        template<int Order>
+        void decodeResiduals(int32_t* x, int frameCount, int k, int shift, BitReader& reader)
+        {
+            for (int i = Order; i < frameCount; i++)
+            {
+                uint32_t const quotient = reader.readUnary();
+                uint64_t const folded = (static_cast<uint64_t>(quotient) << k) | reader.read(k);
+                auto const residual = static_cast<int64_t>(folded >> 1) ^ -static_cast<int64_t>(folded & 1);
+
+                // wrap to the sample size, malformed input produces noise instead of overflowing
+                auto const value = static_cast<uint32_t>(residual + predict<Order>(x, i));
+                x[i] = static_cast<int32_t>(value << shift) >> shift;
+            }
+        }
+    }
+
+
+    bool utility::isLosslessSupported(VBanBitResolution resolution)
+    {
+        return getSampleSize(resolution) > 0;
+    }
+
+
+    size_t utility::encodeLossless(const uint8_t* src, VBanBitResolution resolution, int channelCount, int frameCount, uint8_t* dst, size_t capacity)
+    {
+        int const sample_size = getSampleSize(resolution);
+        if (sample_size == 0 || frameCount <= 0 || frameCount > VBAN_SAMPLES_MAX_NB || capacity < 1 + static_cast<size_t>(channelCount))
+            return 0;
+
+        dst[0] = sTag;
+        BitWriter writer(dst + 1 + channelCount, capacity - 1 - channelCount);
+        int const bits = sample_size * 8;
+        int32_t x[VBAN_SAMPLES_MAX_NB];
+        for (int channel = 0; channel < channelCount; channel++)
+        {
+            switch (sample_size)
+            {
+            case 1:     readChannel<1>(src, channel, channelCount, frameCount, x); break;
+            case 2:     readChannel<2>(src, channel, channelCount, frameCount, x); break;
+            default:    readChannel<3>(src, channel, channelCount, frameCount, x); break;
+            }
+
+            uint64_t sum = 0;
+            int const order = choosePredictor(x, frameCount, sum);
+            int const k = chooseRiceParameter(sum, frameCount - order);
+            dst[1 + channel] = static_cast<uint8_t>((order << 5) | k);
+
+            for (int i = 0; i < order; i++)
+                writer.write(static_cast<uint32_t>(x[i]), bits);
+
+            switch (order)
+            {
+            case 0:     encodeResiduals<0>(x, frameCount, k, writer); break;
+            case 1:     encodeResiduals<1>(x, frameCount, k, writer); break;
+            case 2:     encodeResiduals<2>(x, frameCount, k, writer); break;
+            case 3:     encodeResiduals<3>(x, frameCount, k, writer); break;
+            default:    encodeResiduals<4>(x, frameCount, k, writer); break;
+            }
+
+            if (writer.hasOverflow())
+                return 0;
+        }
+
+        writer.flush();
+        return writer.hasOverflow() ? 0 : 1 + channelCount + writer.getSize();
+    }
+
+
+    bool utility::decodeLossless(const uint8_t* src, size_t size, VBanBitResolution resolution, int channelCount, int frameCount, uint8_t* dst)
+    {
+        int const sample_size = getSampleSize(resolution);
+        if (sample_size == 0 || frameCount <= 0 || frameCount > VBAN_SAMPLES_MAX_NB)
+            return false;
+
+        if (size < 1 + static_cast<size_t>(channelCount) || src[0] != sTag)
+            return false;
+
+        BitReader reader(src + 1 + channelCount, size - 1 - channelCount);
+        int const bits = sample_size * 8;
+        int const shift = 32 - bits;
+        int32_t x[VBAN_SAMPLES_MAX_NB];
+        for (int channel = 0; channel < channelCount; channel++)
+        {
+            int const order = src[1 + channel] >> 5;
+            int const k = src[1 + channel] & sMaxRiceParameter;
+            if (order > sMaxOrder || order > frameCount)
+                return false;
+
+            for (int i = 0; i < order; i++)
+                x[i] = static_cast<int32_t>(reader.read(bits) << shift) >> shift;
+
+            switch (order)
+            {
+            case 0:     decodeResiduals<0>(x, frameCount, k, shift, reader); break;
+            case 1:     decodeResiduals<1>(x, frameCount, k, shift, reader); break;
+            case 2:     decodeResiduals<2>(x, frameCount, k, shift, reader); break;
+            case 3:     decodeResiduals<3>(x, frameCount, k, shift, reader); break;
+            default:    decodeResiduals<4>(x, frameCount, k, shift, reader); break;
+            }
+
+            if (reader.hasOverrun())
+                return false;
+            writeChannel(x, channel, channelCount, frameCount, sample_size, dst);
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// Std includes
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vban/vban.h"
+
+namespace nap
+{
+    namespace utility
+    {
+        /**
+         * Lossless compression of integer PCM payloads, sent as VBAN_CODEC_USER packets.
+         * The header of a compressed packet describes the PCM payload it decompresses to: sample rate,
+         * samples, channels and bit resolution are the same as for the uncompressed packet.
+         *
+         * Every channel is predicted with the best fitting fixed polynomial predictor (order 0 to 4) and the
+         * prediction error is Rice coded with a parameter chosen per channel. A packet only depends on itself,
+         * a lost packet does not affect the packets after it. The compressed payload starts with a tag byte,
+         * followed by a byte per channel holding the predictor order (3 bits) and the Rice parameter (5 bits),
+         * followed by a big endian bit stream with per channel the first 'order' samples verbatim and the coded residuals.
+         */
+
+        /**
+         * @param resolution the bit resolution
+         * @return if the bit resolution can be compressed, 8, 16 and 24 bit integer PCM
+         */
+        bool isLosslessSupported(VBanBitResolution resolution);
+
+        /**
+         * Compresses an interleaved PCM payload. Gives up as soon as the result does not fit, so the cost is bounded
+         * by the size of the payload. Does not allocate.
+         * @param src interleaved little endian PCM, frameCount * channelCount samples
+         * @param resolution bit resolution of the PCM, has to be supported
+         * @param channelCount number of interleaved channels
+         * @param frameCount number of samples per channel, at most VBAN_SAMPLES_MAX_NB
+         * @param dst receives the compressed payload
+         * @param capacity max size of the compressed payload in bytes, pass less than the PCM size to only compress when it pays off
+         * @return size of the compressed payload in bytes, 0 when it does not fit in capacity
+         */
+        size_t encodeLossless(const uint8_t* src, VBanBitResolution resolution, int channelCount, int frameCount, uint8_t* dst, size_t capacity);
+
+        /**
+         * Restores the interleaved PCM payload of a compressed packet. Safe on malformed input, never reads past the
+         * compressed payload and never writes more than the PCM payload. Does not allocate.
+         * @param src the compressed payload
+         * @param size size of the compressed payload in bytes
+         * @param resolution bit resolution of the PCM, as described by the packet header
+         * @param channelCount number of channels, as described by the packet header
+         * @param frameCount number of samples per channel, as described by the packet header
+         * @param dst receives frameCount * channelCount interleaved little endian samples
+         * @return false when the payload is not valid
+         */
+        bool decodeLossless(const uint8_t* src, size_t size, VBanBitResolution resolution, int channelCount, int frameCount, uint8_t* dst);
+    }
+}
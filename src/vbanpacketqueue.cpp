@@ -0,0 +1,222 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "vbanpacketqueue.h"
+
+// Std includes
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace nap
+{
+    static uint64_t roundUpToPowerOfTwo(uint64_t value)
+    {
+        uint64_t size = 1;
+        while (size < value)
+            size <<= 1;
+        return size;
+    }
+
+
+    void VBANWakeSignal::wake()
+    {
+        mPending.store(true);
+        if (!mWaiting.load())
+            return;
+
+        // the waiter checks the pending flag and goes to sleep while holding the mutex, taking it here orders the
+        // notification after that, so it can't get lost in between. Only taken while the consumer is waiting
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+        }
+        mCondition.notify_one();
+    }
+
+
+    void VBANWakeSignal::wait(std::chrono::microseconds timeout)
+    {
+        if (mPending.exchange(false))
+            return;
+
+        // announce the wait before checking for a wake up, so a wake up in between is either seen here or notifies
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWaiting.store(true);
+        mCondition.wait_for(lock, timeout, [this]() { return mPending.load(); });
+        mWaiting.store(false);
+        mPending.store(false);
+    }
+
+
+    void VBANPacketQueue::init(int capacity, size_t maxPacketSize, int maxBatchSize, std::shared_ptr<VBANWakeSignal> signal)
+    {
+        // every buffer is either queued, taken out by the consumer, recycled or free,
+        // one extra buffer guarantees the producer always finds one without waiting for the consumer
+        mCapacity = std::max(capacity, 1);
+        mMaxBatchSize = std::max(maxBatchSize, 1);
+        mMaxPacketSize = maxPacketSize;
+        uint32_t const buffer_count = static_cast<uint32_t>(mCapacity + mMaxBatchSize + 1);
+        mStorage.assign(buffer_count * maxPacketSize, 0);
+        mSizes.assign(buffer_count, 0);
+        mDueTimes = std::vector<std::atomic<int64_t>>(buffer_count);
+
+        uint64_t const queue_size = roundUpToPowerOfTwo(mCapacity);
+        mQueue = std::vector<std::atomic<uint32_t>>(queue_size);
+        mQueueMask = queue_size - 1;
+        mWriteIndex.store(0);
+        mReadIndex.store(0);
+
+        uint64_t const free_size = roundUpToPowerOfTwo(buffer_count);
+        mFree.assign(free_size, 0);
+        mFreeMask = free_size - 1;
+        for (uint32_t buffer = 0; buffer < buffer_count; buffer++)
+            mFree[buffer] = buffer;
+        mFreeWriteIndex.store(buffer_count);
+        mFreeReadIndex.store(0);
+
+        mRecycled.clear();
+        mRecycled.reserve(buffer_count);
+
+        mSignal = signal != nullptr ? std::move(signal) : std::make_shared<VBANWakeSignal>();
+    }
+
+
+    bool VBANPacketQueue::push(const nap::uint8* data, size_t size, int64_t dueTime)
+    {
+        if (size > mMaxPacketSize)
+        {
+            mDropped.add();
+            return false;
+        }
+
+        // the consumer fell behind, drop the oldest packet to make room
+        uint64_t const write_index = mWriteIndex.load(std::memory_order_relaxed);
+        if (write_index - mReadIndex.load(std::memory_order_acquire) >= static_cast<uint64_t>(mCapacity))
+        {
+            uint32_t dropped;
+            if (dropOldest(dropped))
+            {
+                mRecycled.emplace_back(dropped);
+                mDropped.add();
+            }
+        }
+
+        uint32_t buffer;
+        if (!acquire(buffer))
+        {
+            mDropped.add();
+            return false;
+        }
+
+        std::memcpy(&mStorage[buffer * mMaxPacketSize], data, size);
+        mSizes[buffer] = size;
+        mDueTimes[buffer].store(dueTime, std::memory_order_release);
+        mQueue[write_index & mQueueMask].store(buffer, std::memory_order_relaxed);
+        mWriteIndex.store(write_index + 1, std::memory_order_release);
+        mQueued.add();
+        return true;
+    }
+
+
+    int VBANPacketQueue::pop(VBANQueuedPacket* packets, int maxCount, int64_t now)
+    {
+        assert(maxCount <= mMaxBatchSize);
+        int count = 0;
+        uint64_t read_index = mReadIndex.load(std::memory_order_acquire);
+        while (count < maxCount)
+        {
+            if (read_index == mWriteIndex.load(std::memory_order_acquire))
+                break;
+
+            // claim the packet, fails when the producer dropped it in the meantime.
+            // The due time can be stale when the packet was dropped, the claim then fails and the next packet is checked
+            uint32_t const buffer = mQueue[read_index & mQueueMask].load(std::memory_order_relaxed);
+            int64_t const due_time = mDueTimes[buffer].load(std::memory_order_acquire);
+            if (due_time > now)
+            {
+                if (read_index == mReadIndex.load(std::memory_order_acquire))
+                    break;
+                read_index = mReadIndex.load(std::memory_order_acquire);
+                continue;
+            }
+            if (!mReadIndex.compare_exchange_weak(read_index, read_index + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                continue;
+
+            auto& packet = packets[count++];
+            packet.mBuffer = buffer;
+            packet.mData = &mStorage[buffer * mMaxPacketSize];
+            packet.mSize = mSizes[buffer];
+            packet.mDueTime = due_time;
+            read_index++;
+        }
+        return count;
+    }
+
+
+    bool VBANPacketQueue::getNextDueTime(int64_t& dueTime) const
+    {
+        // the producer can drop the packet at any time, retry until the due time belongs to the oldest packet
+        uint64_t read_index = mReadIndex.load(std::memory_order_acquire);
+        while (read_index != mWriteIndex.load(std::memory_order_acquire))
+        {
+            uint32_t const buffer = mQueue[read_index & mQueueMask].load(std::memory_order_relaxed);
+            dueTime = mDueTimes[buffer].load(std::memory_order_acquire);
+            uint64_t const current = mReadIndex.load(std::memory_order_acquire);
+            if (current == read_index)
+                return true;
+            read_index = current;
+        }
+        return false;
+    }
+
+
+    void VBANPacketQueue::release(const VBANQueuedPacket* packets, int count)
+    {
+        // never overflows, the ring can hold all buffers
+        uint64_t write_index = mFreeWriteIndex.load(std::memory_order_relaxed);
+        for (int i = 0; i < count; i++)
+            mFree[write_index++ & mFreeMask] = packets[i].mBuffer;
+        mFreeWriteIndex.store(write_index, std::memory_order_release);
+        mSent.add(count);
+    }
+
+
+    bool VBANPacketQueue::dropOldest(uint32_t& buffer)
+    {
+        uint64_t read_index = mReadIndex.load(std::memory_order_acquire);
+        uint64_t const write_index = mWriteIndex.load(std::memory_order_relaxed);
+        while (read_index != write_index)
+        {
+            buffer = mQueue[read_index & mQueueMask].load(std::memory_order_relaxed);
+            if (mReadIndex.compare_exchange_weak(read_index, read_index + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                return true;
+        }
+        return false;
+    }
+
+
+    bool VBANPacketQueue::acquire(uint32_t& buffer)
+    {
+        if (!mRecycled.empty())
+        {
+            buffer = mRecycled.back();
+            mRecycled.pop_back();
+            return true;
+        }
+
+        uint64_t const read_index = mFreeReadIndex.load(std::memory_order_relaxed);
+        if (read_index != mFreeWriteIndex.load(std::memory_order_acquire))
+        {
+            buffer = mFree[read_index & mFreeMask];
+            mFreeReadIndex.store(read_index + 1, std::memory_order_release);
+            return true;
+        }
+
+        // all buffers are queued or being sent
+        if (!dropOldest(buffer))
+            return false;
+        mDropped.add();
+        return true;
+    }
+}
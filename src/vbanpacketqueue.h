@@ -0,0 +1,184 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Nap includes
+#include <utility/dllexport.h>
+#include <nap/numeric.h>
+
+// Vban includes
+#include "vbanstatistics.h"
+
+// Std includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nap
+{
+    /**
+     * A packet taken from the VBANPacketQueue by the consumer, has to be released after sending
+     */
+    struct VBANQueuedPacket
+    {
+        const nap::uint8* mData = nullptr;  ///< Packet data, valid until the packet is released
+        size_t mSize = 0;                   ///< Size of the packet in bytes
+        uint32_t mBuffer = 0;               ///< Index of the pool buffer holding the packet
+        int64_t mDueTime = 0;               ///< Time the packet is due to be sent, see VBANPacketQueue::getClockTime()
+    };
+
+
+    /**
+     * Wakes up a consumer thread that waits for work, possibly shared by multiple queues.
+     * A wake up is remembered until the consumer waits, signalling a busy consumer costs two atomic operations and no lock.
+     * Waking a consumer that sleeps briefly takes the mutex it waits on.
+     */
+    class NAPAPI VBANWakeSignal
+    {
+    public:
+        /**
+         * Wakes up the consumer, or makes its next wait return immediately. Can be called from any thread.
+         */
+        void wake();
+
+        /**
+         * Blocks until wake() is called or the timeout elapses, returns immediately when woken since the last wait.
+         * @param timeout max time to wait
+         */
+        void wait(std::chrono::microseconds timeout);
+
+    private:
+        std::atomic<bool> mPending = { false };
+        std::atomic<bool> mWaiting = { false };
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+    };
+
+
+    /**
+     * Lock free single producer, single consumer queue of packets, backed by a pool of buffers allocated on init.
+     * The producer, typically the audio thread, never allocates or blocks: when the consumer falls behind and the queue
+     * is full, the oldest queued packet is dropped to make room for the new one, so the queue never adds more latency
+     * than its capacity. The consumer takes packets out in batches and releases their buffers after sending.
+     */
+    class NAPAPI VBANPacketQueue
+    {
+    public:
+        /**
+         * @return the current time of the monotonic clock the due times of the packets refer to, in nanoseconds
+         */
+        static int64_t getClockTime() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+        /**
+         * Allocates the pool, not thread safe
+         * @param capacity max number of queued packets
+         * @param maxPacketSize size of every buffer in the pool in bytes
+         * @param maxBatchSize max number of packets the consumer takes out at once
+         * @param signal the signal that wakes up the consumer, shared with other queues of the same consumer, a new signal is created when nullptr
+         */
+        void init(int capacity, size_t maxPacketSize, int maxBatchSize, std::shared_ptr<VBANWakeSignal> signal = nullptr);
+
+        /**
+         * Copies a packet into a pool buffer and queues it, drops the oldest packet when the queue is full. Producer thread only.
+         * @param data the packet data
+         * @param size the size of the packet in bytes, at most the max packet size
+         * @param dueTime time the packet is due to be sent, see getClockTime(), 0 sends the packet as soon as possible.
+         * Due times of consecutive packets must not decrease.
+         * @return false when the packet did not fit a pool buffer and was dropped
+         */
+        bool push(const nap::uint8* data, size_t size, int64_t dueTime = 0);
+
+        /**
+         * Takes queued packets out of the queue, oldest first. Consumer thread only.
+         * @param packets receives the packets, the buffers stay owned by the consumer until they are released
+         * @param maxCount max number of packets to take out, at most the max batch size
+         * @param now only packets that are due at this time are taken out, see getClockTime()
+         * @return number of packets taken out
+         */
+        int pop(VBANQueuedPacket* packets, int maxCount, int64_t now = std::numeric_limits<int64_t>::max());
+
+        /**
+         * Returns the due time of the oldest queued packet. Consumer thread only.
+         * @param dueTime receives the due time of the packet
+         * @return false when no packets are queued
+         */
+        bool getNextDueTime(int64_t& dueTime) const;
+
+        /**
+         * Returns the buffers of packets taken out with pop() to the pool. Consumer thread only.
+         * @param packets the packets to release
+         * @param count number of packets
+         */
+        void release(const VBANQueuedPacket* packets, int count);
+
+        /**
+         * Wakes up the consumer to send the queued packets, call once after queueing a block of packets. Can be called from any thread.
+         */
+        void wake() { mSignal->wake(); }
+
+        /**
+         * @return the signal the consumer waits on
+         */
+        VBANWakeSignal& getWakeSignal() { return *mSignal; }
+
+        /**
+         * @return true when no packets are queued
+         */
+        bool isEmpty() const { return mReadIndex.load(std::memory_order_acquire) == mWriteIndex.load(std::memory_order_acquire); }
+
+        /**
+         * @return number of packets queued since init, can be called from any thread
+         */
+        uint64_t getQueuedCount() const { return mQueued.get(); }
+
+        /**
+         * @return number of packets dropped because the queue was full, can be called from any thread
+         */
+        uint64_t getDroppedCount() const { return mDropped.get(); }
+
+        /**
+         * @return number of packets taken out and released by the consumer, can be called from any thread
+         */
+        uint64_t getSentCount() const { return mSent.get(); }
+
+    private:
+        // Removes the oldest queued packet, producer thread only, returns false when the consumer took it out first
+        bool dropOldest(uint32_t& buffer);
+
+        // Takes a buffer for a new packet, producer thread only
+        bool acquire(uint32_t& buffer);
+
+        std::vector<nap::uint8> mStorage;           // All pool buffers
+        std::vector<size_t> mSizes;                 // Size of the packet in every pool buffer
+        std::vector<std::atomic<int64_t>> mDueTimes; // Due time of the packet in every pool buffer, read by the consumer before claiming a packet
+        size_t mMaxPacketSize = 0;
+        int mMaxBatchSize = 0;
+
+        // Queued buffer indices, the read index is advanced by the consumer and, to drop the oldest, by the producer
+        std::vector<std::atomic<uint32_t>> mQueue;
+        uint64_t mQueueMask = 0;
+        int mCapacity = 0;
+        alignas(64) std::atomic<uint64_t> mWriteIndex = { 0 };
+        alignas(64) std::atomic<uint64_t> mReadIndex = { 0 };
+
+        // Buffers released by the consumer, a single producer single consumer ring from the consumer to the producer
+        std::vector<uint32_t> mFree;
+        uint64_t mFreeMask = 0;
+        alignas(64) std::atomic<uint64_t> mFreeWriteIndex = { 0 };
+        alignas(64) std::atomic<uint64_t> mFreeReadIndex = { 0 };
+
+        std::vector<uint32_t> mRecycled;            // Buffers of dropped packets, only used by the producer
+
+        std::shared_ptr<VBANWakeSignal> mSignal = nullptr;
+
+        VBANCounter mQueued;
+        VBANCounter mDropped;
+        VBANCounter mSent;
+    };
+}
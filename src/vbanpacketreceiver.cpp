@@ -9,9 +9,18 @@
 
 #include "vban/vban.h"
 #include "vbanutils.h"
+#include "vbancodec.h"
+#include "vbanlosslesscodec.h"
+
+// Std includes
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
 
 RTTI_BEGIN_CLASS(nap::VBANPacketReceiver)
-RTTI_PROPERTY("Server", &nap::VBANPacketReceiver::mServer, nap::rtti::EPropertyMetaData::Required)
+RTTI_PROPERTY("Server", &nap::VBANPacketReceiver::mServer, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("BatchServer", &nap::VBANPacketReceiver::mBatchServer, nap::rtti::EPropertyMetaData::Default)
 RTTI_END_CLASS
 
 namespace nap
@@ -19,180 +28,358 @@ namespace nap
 
 	bool VBANPacketReceiver::init(utility::ErrorState& errorState)
 	{
-        mServer->registerListenerSlot(mPacketReceivedSlot);
+        if (!errorState.check((mServer != nullptr) != (mBatchServer != nullptr), "%s: either Server or BatchServer has to be set", mID.c_str()))
+            return false;
+
+        // every shard decodes into its own scratch storage, large enough for the largest packet the protocol allows
+        int const shard_count = mBatchServer != nullptr ? mBatchServer->getShardCount() : 1;
+        for (int i = 0; i < shard_count; i++)
+        {
+            auto shard = std::make_unique<Shard>();
+            shard->mDecodeBuffer.resize(VBAN_CHANNELS_MAX_NB * VBAN_SAMPLES_MAX_NB);
+            shard->mPayloadBuffer.resize(VBAN_DATA_MAX_SIZE);
+            shard->mTable.store(new DispatchTable());
+            mShards.emplace_back(std::move(shard));
+        }
+
+        if (mServer != nullptr)
+            mServer->registerListenerSlot(mPacketReceivedSlot);
+        else
+            mBatchServer->registerListenerSlot(mBatchReceivedSlot);
 
 		return true;
 	}
 
 
+    void VBANPacketReceiver::onDestroy()
+    {
+        if (mServer != nullptr)
+            mServer->removeListenerSlot(mPacketReceivedSlot);
+        else if (mBatchServer != nullptr)
+            mBatchServer->removeListenerSlot(mBatchReceivedSlot);
+    }
+
+
+    VBANPacketReceiver::~VBANPacketReceiver()
+    {
+        for (auto& shard : mShards)
+            delete shard->mTable.exchange(nullptr);
+    }
+
+
 	void VBANPacketReceiver::packetReceived(const UDPPacket &packet)
 	{
-        // Process adding or removing receivers
-        mTaskQueue.process();
-
-		utility::ErrorState errorState;
-		if (checkPacket(errorState, &packet.data()[0], packet.size()) ) {
-            struct VBanHeader const *const hdr = (struct VBanHeader *) (&packet.data()[0]);
-
-            // get packet meta-data
-            int const nb_samples = hdr->format_nbs + 1;
-            int const nb_channels = hdr->format_nbc + 1;
-            size_t sample_size = VBanBitResolutionSize[static_cast<const VBanBitResolution>(hdr->format_bit &
-                                                                                            VBAN_BIT_RESOLUTION_MASK)];
-            size_t payload_size = nb_samples * sample_size * nb_channels;
-
-            // create buffers to push to players
-            std::vector<std::vector<float>> buffers;
-            int float_buffer_size = (payload_size / sample_size) / nb_channels;
-            for (int i = 0; i < nb_channels; i++) {
-                std::vector<float> new_buffer;
-                new_buffer.resize(float_buffer_size);
-                buffers.emplace_back(new_buffer);
-            }
+        // the table is not freed while the sequence is odd, see publish()
+        Shard& shard = *mShards.front();
+        shard.mSequence.fetch_add(1);
+        DispatchTable* table = shard.mTable.load();
 
-            // convert WAVE PCM multiplexed signal into floating point (SampleValue) buffers for each channel
-            for (size_t i = 0; i < float_buffer_size; i++)
-            {
-                for (int c = 0; c < nb_channels; c++)
-                {
-                    size_t pos = (i * nb_channels * 2) + (c * 2) + VBAN_HEADER_SIZE;
-                    char byte_1 = packet.data()[pos];
-                    char byte_2 = packet.data()[pos + 1];
-                    short original_value = ((static_cast<short>(byte_2)) << 8) | (0x00ff & byte_1);
+        int64_t const receive_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        processPacket(shard, *table, &packet.data()[0], packet.size(), receive_time);
 
-                    buffers[c][i] = ((float) original_value) / (float) 32768;
-                }
+        shard.mSequence.fetch_add(1, std::memory_order_release);
+	}
+
+
+    void VBANPacketReceiver::batchReceived(const VBANPacketBatch& batch)
+    {
+        assert(batch.mShard < static_cast<int>(mShards.size()));
+        Shard& shard = *mShards[batch.mShard];
+
+        // pick up the listeners once for the whole batch, the table is not freed while the sequence is odd
+        shard.mSequence.fetch_add(1);
+        DispatchTable* table = shard.mTable.load();
+
+        for (int i = 0; i < batch.mCount; i++)
+            processPacket(shard, *table, batch.mPackets[i].mData, batch.mPackets[i].mSize, batch.mPackets[i].mReceiveTime);
+
+        shard.mSequence.fetch_add(1, std::memory_order_release);
+    }
+
+
+    void VBANPacketReceiver::processPacket(Shard& shard, DispatchTable& table, nap::uint8 const* buffer, size_t size, int64_t receiveTime)
+    {
+        mPacketCount.add();
+
+        // cheap rejects first, most foreign traffic on the port ends here
+        if (size <= VBAN_HEADER_SIZE)
+        {
+            reject(EVBANPacketError::TooSmall);
+            return;
+        }
+
+        struct VBanHeader const *const hdr = (struct VBanHeader *) (buffer);
+        if (hdr->vban != *(uint32_t*)("VBAN"))
+        {
+            reject(EVBANPacketError::InvalidMagic);
+            return;
+        }
+
+        // find the listeners of this stream, skip validation and decoding when nobody is listening
+        auto stream = table.find(utility::makeVBANStreamKey(hdr->streamname));
+        if (stream == table.end())
+        {
+            reject(EVBANPacketError::NoListener);
+            return;
+        }
+
+        // a header with the same format as the last valid packet of the stream only needs a size check,
+        // compressed and PCM packets of a stream share the format, the codec is checked per packet
+        StreamEntry& entry = stream->second;
+        nap::uint8 const codec = hdr->format_bit & VBAN_CODEC_MASK;
+        nap::uint8 const format_bytes[4] = { hdr->format_SR, hdr->format_nbs, hdr->format_nbc, static_cast<nap::uint8>(hdr->format_bit & ~VBAN_CODEC_MASK) };
+        uint32_t format;
+        std::memcpy(&format, format_bytes, sizeof(format));
+        if (entry.mCodec == nullptr || format != entry.mFormat)
+        {
+            EVBANPacketError const error = checkPacket(buffer, size);
+            if (error != EVBANPacketError::None)
+            {
+                reject(error);
+                return;
             }
 
-            // get sample rate
-            int const sample_rate_format   = hdr->format_SR & VBAN_SR_MASK;
-            int sample_rate = 0;
-            if(utility::getSampleRateFromVBANSampleRateFormat(sample_rate, sample_rate_format, errorState))
+            entry.mFormat = format;
+            entry.mCodec = utility::getVBANCodec(static_cast<VBanBitResolution>(hdr->format_bit & VBAN_BIT_RESOLUTION_MASK));
+            entry.mPacketSize = VBAN_HEADER_SIZE + static_cast<size_t>(hdr->format_nbs + 1) * (hdr->format_nbc + 1) * entry.mCodec->mSampleSize;
+            entry.mSampleRate = VBanSRList[hdr->format_SR & VBAN_SR_MASK];
+            entry.mCounters->mFormatChanges.add();
+        }
+        else if (codec != VBAN_CODEC_PCM && codec != VBAN_CODEC_USER)
+        {
+            reject(EVBANPacketError::UnsupportedCodec);
+            return;
+        }
+        else if (codec == VBAN_CODEC_PCM && size < entry.mPacketSize)
+        {
+            reject(EVBANPacketError::PayloadTooSmall);
+            return;
+        }
+
+        // get packet meta-data
+        int const nb_samples = hdr->format_nbs + 1;
+        int const nb_channels = hdr->format_nbc + 1;
+
+        // hand out a view on the decoded data, no copies are made
+        VBANBufferView view;
+        view.mData = shard.mDecodeBuffer.data();
+        view.mChannelCount = nb_channels;
+        view.mFrameCounter = hdr->nuFrame;
+        view.mSampleRate = entry.mSampleRate;
+        view.mReceiveTime = receiveTime;
+
+        // a silence descriptor stands in for the packets the sender suppresses, there is nothing to decode.
+        // It is exactly the header and the tag, other payloads of the user codec starting with the tag are not silence
+        view.mSilence = codec == VBAN_CODEC_USER && size == VBAN_SILENCE_DESCRIPTOR_SIZE && buffer[VBAN_HEADER_SIZE] == VBAN_SILENCE_DESCRIPTOR_TAG;
+        if (!view.mSilence)
+        {
+            // restore the PCM payload of a compressed packet, it never exceeds the max size of a PCM payload
+            nap::uint8 const* payload = &buffer[VBAN_HEADER_SIZE];
+            if (codec == VBAN_CODEC_USER)
             {
-                // get stream name, use it to forward buffers to any registered stream audio receivers
-                std::string stream_name(hdr->streamname);
-                for(auto* receiver : mReceivers)
+                if (entry.mPacketSize > VBAN_PROTOCOL_MAX_SIZE ||
+                    !utility::decodeLossless(payload, size - VBAN_HEADER_SIZE, entry.mCodec->mResolution, nb_channels, nb_samples, shard.mPayloadBuffer.data()))
                 {
-                    if(receiver->getStreamName() == stream_name)
-                    {
-                        receiver->pushBuffers(buffers);
-                    }
+                    reject(EVBANPacketError::InvalidCompressedPayload);
+                    return;
                 }
-            }else
-            {
-                nap::Logger::error(errorState.toString());
+                payload = shard.mPayloadBuffer.data();
             }
-		}
-        else
-        {
-			nap::Logger::warn(*this, errorState.toString());
-		}
+
+            // convert WAVE PCM multiplexed signal into planar floating point (SampleValue) data for each channel
+            entry.mCodec->mDecode(payload, shard.mDecodeBuffer.data(), nb_channels, nb_samples);
+            view.mFrameCount = nb_samples;
+        }
+
+        entry.mCounters->mPackets.add();
+        entry.mCounters->mBytes.add(size);
+        entry.mCounters->mFrames.add(static_cast<uint64_t>(view.mFrameCount));
+
+        // forward buffers to all stream audio receivers registered to this stream
+        for(auto* receiver : entry.mListeners)
+            receiver->pushBuffers(view);
 	}
 
 
-	bool VBANPacketReceiver::checkPacket(utility::ErrorState& errorState, nap::uint8 const* buffer, size_t size)
+	EVBANPacketError VBANPacketReceiver::checkPacket(nap::uint8 const* buffer, size_t size)
 	{
 		struct VBanHeader const* const hdr = (struct VBanHeader*)(buffer);
-		enum VBanProtocol protocol = static_cast<VBanProtocol>(VBAN_PROTOCOL_UNDEFINED_4);
-		enum VBanCodec codec = static_cast<VBanCodec>(VBAN_BIT_RESOLUTION_MAX);
 
-		if(!errorState.check(buffer != 0, "buffer is null ptr"))
-			return false;
+		if(size <= VBAN_HEADER_SIZE)
+			return EVBANPacketError::TooSmall;
 
-		if(!errorState.check(size > VBAN_HEADER_SIZE, "packet too small"))
-			return false;
+		if(hdr->vban != *(uint32_t*)("VBAN"))
+			return EVBANPacketError::InvalidMagic;
 
-		if(!errorState.check(hdr->vban == *(int32_t*)("VBAN"), "invalid vban magic fourc"))
-			return false;
+		if((hdr->format_bit & VBAN_RESERVED_MASK) != 0)
+			return EVBANPacketError::ReservedBit;
 
-		if(!errorState.check(hdr->format_bit == VBAN_BITFMT_16_INT, "reserved format bit invalid value, only 16 bit PCM supported at this time"))
-			return false;
+		// check protocol and codec
+		enum VBanProtocol const protocol = static_cast<VBanProtocol>(hdr->format_SR & VBAN_PROTOCOL_MASK);
+		enum VBanCodec const codec = static_cast<VBanCodec>(hdr->format_bit & VBAN_CODEC_MASK);
 
-        if(!errorState.check((hdr->format_nbc + 1) > 0, "channel count cannot be 0 or smaller"))
-            return false;
+		if(protocol != VBAN_PROTOCOL_AUDIO)
+			return EVBANPacketError::UnsupportedProtocol;
 
-		// check protocol and codec
-		protocol        = static_cast<VBanProtocol>(hdr->format_SR & VBAN_PROTOCOL_MASK);
-		codec           = static_cast<VBanCodec>(hdr->format_bit & VBAN_CODEC_MASK);
-
-		if( protocol != VBAN_PROTOCOL_AUDIO )
-		{
-			switch (protocol)
-			{
-			case VBAN_PROTOCOL_SERIAL:
-			case VBAN_PROTOCOL_TXT:
-			case VBAN_PROTOCOL_UNDEFINED_1:
-			case VBAN_PROTOCOL_UNDEFINED_2:
-			case VBAN_PROTOCOL_UNDEFINED_3:
-			case VBAN_PROTOCOL_UNDEFINED_4:
-				errorState.fail("protocol not supported yet");
-			default:
-				errorState.fail("packet with unknown protocol");
-			}
-
-			return false;
-		}else
-		{
-			if(!errorState.check(codec == VBAN_CODEC_PCM, "unsupported codec"))
-				return false;
-
-			if(!checkPcmPacket(errorState, buffer, size))
-				return false;
-		}
+		if(codec != VBAN_CODEC_PCM && codec != VBAN_CODEC_USER)
+			return EVBANPacketError::UnsupportedCodec;
 
-		return true;
+		return checkPcmPacket(buffer, size);
 	}
 
 
-	bool VBANPacketReceiver::checkPcmPacket(utility::ErrorState& errorState, const nap::uint8* buffer, size_t size)
+	EVBANPacketError VBANPacketReceiver::checkPcmPacket(const nap::uint8* buffer, size_t size)
 	{
 		// the packet is already a valid vban packet and buffer already checked before
 		struct VBanHeader const* const hdr = (struct VBanHeader*)(buffer);
 		enum VBanBitResolution const bit_resolution = static_cast<const VBanBitResolution>(hdr->format_bit & VBAN_BIT_RESOLUTION_MASK);
 		int const sample_rate_format   = hdr->format_SR & VBAN_SR_MASK;
 
-		if(!errorState.check(bit_resolution < VBAN_BIT_RESOLUTION_MAX, "invalid bit resolution"))
-			return false;
+		if(bit_resolution >= VBAN_BIT_RESOLUTION_MAX)
+			return EVBANPacketError::InvalidBitResolution;
 
-		if(!errorState.check(sample_rate_format < VBAN_SR_MAXNUMBER, "invalid sample rate"))
-			return false;
+		if(utility::getVBANCodec(bit_resolution) == nullptr)
+			return EVBANPacketError::UnsupportedBitResolution;
 
-		return true;
+		if(sample_rate_format >= VBAN_SR_MAXNUMBER)
+			return EVBANPacketError::InvalidSampleRate;
+
+        // make sure the payload described by the header is actually present, compressed payloads are checked when decompressed
+        size_t const payload_size = static_cast<size_t>(hdr->format_nbs + 1) * (hdr->format_nbc + 1) * VBanBitResolutionSize[bit_resolution];
+        if((hdr->format_bit & VBAN_CODEC_MASK) == VBAN_CODEC_PCM && size < VBAN_HEADER_SIZE + payload_size)
+            return EVBANPacketError::PayloadTooSmall;
+
+		return EVBANPacketError::None;
 	}
 
 
+    uint64_t VBANPacketReceiver::getRejectCount(EVBANPacketError reason) const
+    {
+        assert(reason != EVBANPacketError::Count);
+        return mRejectCounts[static_cast<size_t>(reason)].load(std::memory_order_relaxed);
+    }
+
+
+    void VBANPacketReceiver::getStatistics(VBANReceiverStatistics& statistics)
+    {
+        statistics.mPackets = mPacketCount.get();
+        for (size_t i = 0; i < statistics.mRejects.size(); i++)
+            statistics.mRejects[i] = mRejectCounts[i].load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        statistics.mStreams.clear();
+        for (auto& it : mStreamCounters)
+        {
+            VBANReceiverStatistics::Stream stream;
+            stream.mStreamName = it.second->mStreamName;
+            stream.mPackets = it.second->mPackets.get();
+            stream.mBytes = it.second->mBytes.get();
+            stream.mFrames = it.second->mFrames.get();
+            stream.mFormatChanges = it.second->mFormatChanges.get();
+            statistics.mStreams.emplace_back(std::move(stream));
+        }
+    }
+
+
+    void VBANPacketReceiver::reject(EVBANPacketError reason)
+    {
+        mRejectCounts[static_cast<size_t>(reason)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+
 	void VBANPacketReceiver::registerStreamListener(IVBANStreamListener* receiver)
 	{
-		mTaskQueue.enqueue([this, receiver]()
-		{
-			auto it = std::find_if(mReceivers.begin(), mReceivers.end(), [receiver](auto& a) { return a == receiver; });
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        auto it = std::find_if(mRegistrations.begin(), mRegistrations.end(), [receiver](auto& a) { return a.mListener == receiver; });
+        assert(it == mRegistrations.end()); // receiver already registered
+        if (it != mRegistrations.end())
+            return;
 
-			assert(it == mReceivers.end()); // receiver already registered
+        Registration registration;
+        registration.mListener = receiver;
+        registration.mKey = utility::makeVBANStreamKey(receiver->getStreamName());
 
-			if (it == mReceivers.end())
-			{
-				mReceivers.emplace_back(receiver);
-			}
-		});
+        // the counters of a stream outlive its listeners, so they can be read while listeners come and go
+        auto& counters = mStreamCounters[registration.mKey];
+        if (counters == nullptr)
+        {
+            counters = std::make_unique<StreamCounters>();
+            counters->mStreamName = receiver->getStreamName();
+        }
+        registration.mCounters = counters.get();
+
+        mRegistrations.emplace_back(registration);
+        publish();
 	}
 
 
 	void VBANPacketReceiver::removeStreamListener(IVBANStreamListener* receiver)
 	{
-		mTaskQueue.enqueue([this, receiver]()
-		{
-			auto it = std::find_if(mReceivers.begin(), mReceivers.end(), [receiver](auto& a)
-			{
-				return a == receiver;
-			});
-
-			assert(it != mReceivers.end()); // receiver not registered
-
-			if(it != mReceivers.end())
-			{
-			  	mReceivers.erase(it);
-			}
-		});
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        auto it = std::find_if(mRegistrations.begin(), mRegistrations.end(), [receiver](auto& a) { return a.mListener == receiver; });
+        assert(it != mRegistrations.end()); // receiver not registered
+        if (it == mRegistrations.end())
+            return;
+
+        mRegistrations.erase(it);
+        publish();
 	}
 
-}
\ No newline at end of file
+
+    void VBANPacketReceiver::publish()
+    {
+        // build the new tables up front, a stream is only listed by the shard its packets are steered to,
+        // so a listener is never called from two shards at once
+        std::vector<std::unique_ptr<DispatchTable>> tables;
+        for (size_t i = 0; i < mShards.size(); i++)
+            tables.emplace_back(std::make_unique<DispatchTable>());
+        for (auto& registration : mRegistrations)
+        {
+            int const shard = utility::getVBANStreamShard(registration.mKey, static_cast<int>(mShards.size()));
+            StreamEntry& entry = (*tables[shard])[registration.mKey];
+            entry.mListeners.emplace_back(registration.mListener);
+            entry.mCounters = registration.mCounters;
+        }
+
+        // swap in the new tables, a shard that starts dispatching from now on uses the new table
+        std::vector<std::unique_ptr<DispatchTable>> retired;
+        for (size_t i = 0; i < mShards.size(); i++)
+            retired.emplace_back(mShards[i]->mTable.exchange(tables[i].release()));
+
+        // wait for shards that are dispatching with an old table to finish
+        for (auto& shard : mShards)
+        {
+            uint64_t const sequence = shard->mSequence.load();
+            if ((sequence & 1) == 0)
+                continue;
+
+            while (shard->mSequence.load(std::memory_order_acquire) == sequence)
+                std::this_thread::yield();
+        }
+
+        // the retired tables are freed when going out of scope
+    }
+
+
+    const char* utility::toString(EVBANPacketError error)
+    {
+        switch (error)
+        {
+        case EVBANPacketError::None:                        return "None";
+        case EVBANPacketError::TooSmall:                    return "Too small";
+        case EVBANPacketError::InvalidMagic:                return "Invalid magic";
+        case EVBANPacketError::NoListener:                  return "No listener";
+        case EVBANPacketError::ReservedBit:                 return "Reserved bit set";
+        case EVBANPacketError::UnsupportedProtocol:         return "Unsupported protocol";
+        case EVBANPacketError::UnsupportedCodec:            return "Unsupported codec";
+        case EVBANPacketError::InvalidBitResolution:        return "Invalid bit resolution";
+        case EVBANPacketError::UnsupportedBitResolution:    return "Unsupported bit resolution";
+        case EVBANPacketError::InvalidSampleRate:           return "Invalid sample rate";
+        case EVBANPacketError::PayloadTooSmall:             return "Payload too small";
+        case EVBANPacketError::InvalidCompressedPayload:    return "Invalid compressed payload";
+        default:                                            return "Unknown";
+        }
+    }
+}
@@ -8,11 +8,47 @@
 #include <nap/resource.h>
 #include <udpserver.h>
 #include <udppacket.h>
-#include <utility/threading.h>
+
+// Vban includes
+#include "vbanutils.h"
+#include "vbanudpserver.h"
+#include "vbancodec.h"
+#include "vbanstatistics.h"
+
+// Std includes
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 namespace nap
 {
 
+    /**
+     * Non-owning view on a block of decoded, planar audio of a single VBAN packet.
+     * All channels are stored contiguously, channel c starts at mData + c * mFrameCount.
+     * The view is only valid for the duration of the IVBANStreamListener::pushBuffers call.
+     */
+    struct NAPAPI VBANBufferView
+    {
+        const float* mData = nullptr;   ///< Planar sample data of all channels
+        int mChannelCount = 0;          ///< Number of channels in the view
+        int mFrameCount = 0;            ///< Number of samples per channel
+        uint32_t mFrameCounter = 0;     ///< The growing frame number (nuFrame) of the packet
+        int mSampleRate = 0;            ///< Sample rate of the stream
+        int64_t mReceiveTime = 0;       ///< Time the packet was received on the steady clock in nanoseconds, see VBANLatencyMonitor
+        bool mSilence = false;          ///< The packet is a silence descriptor, the sender suppresses silent packets until it sends audio again. Carries no samples, mFrameCount is 0
+
+        /**
+         * Returns pointer to the first sample of the given channel, no bound checking, assert on out of bound
+         * @param channel the channel
+         * @return pointer to the first sample of the channel
+         */
+        const float* getChannel(int channel) const { assert(channel < mChannelCount); return mData + static_cast<size_t>(channel) * mFrameCount; }
+    };
+
+
     /**
      * Derive from this class to handle an incoming VBAN audio stream.
      */
@@ -22,10 +58,11 @@ namespace nap
         virtual ~IVBANStreamListener() = default;
 
         /**
-         * Has to be overridden to handle incoming audio data for the stream
-         * @param buffers multichannel audio buffer containing audio for each channel in the stream
+         * Has to be overridden to handle incoming audio data for the stream.
+         * Called from the network thread, the view is only valid for the duration of the call.
+         * @param buffers non-owning view on the planar audio of each channel in the stream
          */
-        virtual void pushBuffers(const std::vector<std::vector<float>>& buffers) = 0;
+        virtual void pushBuffers(const VBANBufferView& buffers) = 0;
 
         /**
          * @return Has to return the name of the VBAN audio stream that this receiver will handle.
@@ -41,8 +78,70 @@ namespace nap
 
 
     /**
-     * Resource that listens to incoming VBAN UDP packets on an UDPServer object.
+     * Reasons a received packet is not dispatched, counted per reason by the VBANPacketReceiver
+     */
+    enum class EVBANPacketError : int
+    {
+        None = 0,                   ///< Valid packet
+        TooSmall,                   ///< Packet not larger than a VBAN header
+        InvalidMagic,               ///< Packet does not start with 'VBAN'
+        NoListener,                 ///< Valid header but no listener registered for the stream
+        ReservedBit,                ///< Reserved format bit is set
+        UnsupportedProtocol,        ///< Not an audio packet
+        UnsupportedCodec,           ///< Audio packet with a codec other than PCM or the lossless user codec
+        InvalidBitResolution,       ///< Bit resolution out of range
+        UnsupportedBitResolution,   ///< Bit resolution without a codec, e.g. 12 and 10 bit
+        InvalidSampleRate,          ///< Sample rate index out of range
+        PayloadTooSmall,            ///< Packet smaller than the payload described by the header
+        InvalidCompressedPayload,   ///< Lossless compressed payload that can not be decompressed, or of another user codec
+        Count                       ///< Number of error codes
+    };
+
+
+    namespace utility
+    {
+        /**
+         * @param error the packet error
+         * @return a readable name of the error
+         */
+        const char* toString(EVBANPacketError error);
+    }
+
+
+    /**
+     * Snapshot of the packets handled by a VBANPacketReceiver, see VBANPacketReceiver::getStatistics()
+     */
+    struct NAPAPI VBANReceiverStatistics
+    {
+        /**
+         * Counters of a single stream that has, or had, a registered listener
+         */
+        struct Stream
+        {
+            std::string mStreamName;        ///< Name of the stream
+            uint64_t mPackets = 0;          ///< Valid packets dispatched to the listeners
+            uint64_t mBytes = 0;            ///< Size of the dispatched packets in bytes, including the header
+            uint64_t mFrames = 0;           ///< Samples per channel in the dispatched packets
+            uint64_t mFormatChanges = 0;    ///< Number of times the packet format changed and was validated completely
+        };
+
+        uint64_t mPackets = 0;                                                          ///< All packets received
+        std::array<uint64_t, static_cast<size_t>(EVBANPacketError::Count)> mRejects = {}; ///< Rejected packets per reason
+        std::vector<Stream> mStreams;                                                   ///< Counters per stream
+    };
+
+
+    /**
+     * Resource that listens to incoming VBAN UDP packets on an UDPServer or a VBANUDPServer object.
      * The VBANPacketReceiver parses the packets and dispatches them to different IVBANStreamAudioReceiver objects for each stream.
+     * Exactly one of both servers has to be set, the VBANUDPServer delivers packets in batches and is preferred for high packet rates.
+     * When the VBANUDPServer is sharded every shard decodes on its own thread with its own listener table.
+     * A stream is listed in the table of the shard the server steers it to, so its listeners are always notified
+     * from the same thread.
+     * Listeners are published as an immutable table per shard that the network thread picks up with a single atomic load
+     * per batch. Registering and removing listeners takes effect immediately, once removeStreamListener() returns the
+     * listener is not called anymore and can be destroyed.
+     * Rejected packets are not logged but counted by reason, see getRejectCount().
      */
 	class NAPAPI VBANPacketReceiver final : public Resource
 	{
@@ -51,33 +150,119 @@ namespace nap
 	public:
         // Inherited from Resource
 		virtual bool init(utility::ErrorState& errorState);
+		virtual void onDestroy();
 
         /**
-         * Register a new receiver for a certain stream
+         * Frees the listener tables
+         */
+        ~VBANPacketReceiver() override;
+
+        /**
+         * Register a new receiver for a certain stream, call from the main thread.
+         * The stream name of the listener is read on registration, re-register the listener when its stream name changes.
          * @param listener IVBANStreamListener object that handles incoming VBAN packets for a VBAN stream
          */
 		void registerStreamListener(IVBANStreamListener* listener);
 
         /**
-         * Unregister an existing receiver
+         * Unregister an existing receiver, call from the main thread.
+         * Waits until packets that are being dispatched on the network thread are handled, the listener is not called after this returns.
          * @param listener IVBANStreamListener object that handles incoming VBAN packets for a VBAN stream
          */
 		void removeStreamListener(IVBANStreamListener* listener);
 
+        /**
+         * Returns the number of packets rejected for the given reason since init, can be called from any thread
+         * @param reason the reason of rejection
+         * @return number of rejected packets
+         */
+        uint64_t getRejectCount(EVBANPacketError reason) const;
+
+        /**
+         * Copies all packet counters, call from the main thread.
+         * The counters are updated on the network thread without locks, the snapshot is not atomic as a whole.
+         * @param statistics receives the counters
+         */
+        void getStatistics(VBANReceiverStatistics& statistics);
+
 	public:
         ResourcePtr<UDPServer> mServer = nullptr; ///< Property: 'Server' Pointer to the UDP server receiving the packets
+        ResourcePtr<VBANUDPServer> mBatchServer = nullptr; ///< Property: 'BatchServer' Pointer to the batched VBAN receive backend, alternative to 'Server'
 
 	protected:
         Slot<const UDPPacket&> mPacketReceivedSlot = { this, &VBANPacketReceiver::packetReceived };
 		void packetReceived(const UDPPacket& packet);
 
-	private:
-		bool checkPacket(utility::ErrorState& errorState, nap::uint8 const* buffer, size_t size);
-		bool checkPcmPacket(utility::ErrorState& errorState, nap::uint8 const* buffer, size_t size);
+        Slot<const VBANPacketBatch&> mBatchReceivedSlot = { this, &VBANPacketReceiver::batchReceived };
+        void batchReceived(const VBANPacketBatch& batch);
 
 	private:
-		std::vector<IVBANStreamListener*> mReceivers;
-        TaskQueue mTaskQueue;
+        /**
+         * Counters of a single stream, created when the first listener of the stream registers and kept until destruction
+         */
+        struct StreamCounters
+        {
+            std::string mStreamName;
+            VBANCounter mPackets;
+            VBANCounter mBytes;
+            VBANCounter mFrames;
+            VBANCounter mFormatChanges;
+        };
+
+        /**
+         * A registered listener and the stream it listens to
+         */
+        struct Registration
+        {
+            IVBANStreamListener* mListener = nullptr;
+            VBANStreamKey mKey;
+            StreamCounters* mCounters = nullptr;
+        };
+
+        /**
+         * Listeners of a stream and the format of the last valid packet, a packet with the same 4 byte
+         * format word is known to be valid once its size matches. The listeners are immutable once published,
+         * the cached format is only written by the thread of the shard owning the entry.
+         */
+        struct StreamEntry
+        {
+            std::vector<IVBANStreamListener*> mListeners;
+            const VBANCodec* mCodec = nullptr;  // Codec of the cached format, nullptr when nothing is cached
+            uint32_t mFormat = 0;               // format_SR, format_nbs, format_nbc and format_bit without the codec of the cached format
+            size_t mPacketSize = 0;             // Min packet size for the cached format
+            int mSampleRate = 0;                // Sample rate of the cached format
+            StreamCounters* mCounters = nullptr;
+        };
+
+        using DispatchTable = std::unordered_map<VBANStreamKey, StreamEntry, VBANStreamKeyHash>;
+
+        /**
+         * Receive state of a single server shard
+         */
+        struct Shard
+        {
+            std::atomic<DispatchTable*> mTable = { nullptr };   // Listeners grouped by stream, replaced on the main thread when listeners change
+            std::atomic<uint64_t> mSequence = { 0 };            // Odd while the shard thread dispatches packets with the table
+            std::vector<float> mDecodeBuffer;                   // Preallocated planar scratch storage packets are decoded into, only used by the shard thread
+            std::vector<nap::uint8> mPayloadBuffer;             // Preallocated PCM payload compressed packets are restored into, only used by the shard thread
+        };
+
+        void processPacket(Shard& shard, DispatchTable& table, nap::uint8 const* buffer, size_t size, int64_t receiveTime);
+		EVBANPacketError checkPacket(nap::uint8 const* buffer, size_t size);
+		EVBANPacketError checkPcmPacket(nap::uint8 const* buffer, size_t size);
+        void reject(EVBANPacketError reason);
+
+        void publish();
+
+        std::vector<std::unique_ptr<Shard>> mShards; // One per server shard, a packet is handled by the shard it was received on
+        std::array<std::atomic<uint64_t>, static_cast<size_t>(EVBANPacketError::Count)> mRejectCounts = {};
+        VBANCounter mPacketCount;
+
+        // Registered listeners and the stream counters by stream, the counters only grow.
+        // Guarded by the mutex on the main thread, the network thread only uses the published tables
+        std::vector<Registration> mRegistrations;
+        std::unordered_map<VBANStreamKey, std::unique_ptr<StreamCounters>, VBANStreamKeyHash> mStreamCounters;
+        std::mutex mMutex;
 	};
 
 
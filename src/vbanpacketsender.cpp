@@ -0,0 +1,134 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "vbanpacketsender.h"
+#include "vbanutils.h"
+
+// Std includes
+#include <algorithm>
+
+// Platform includes
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+namespace nap
+{
+    // Max number of packets taken out of the queue at once
+    static constexpr int sBatchSize = 32;
+
+    // Max time the sender thread waits for packets before checking if it has to stop, new packets and stop() wake it up
+    static constexpr std::chrono::microseconds sWaitTimeout(100000);
+
+
+    struct VBANPacketSender::Socket
+    {
+        VBANSocketHandle mHandle = VBAN_INVALID_SOCKET;
+        std::vector<sockaddr_in> mAddresses;    // Every packet is sent to all addresses
+    };
+
+
+    VBANPacketSender::VBANPacketSender(int queueSize, size_t maxPacketSize)
+    {
+        mQueue = std::make_shared<VBANPacketQueue>();
+        mQueue->init(queueSize, maxPacketSize, sBatchSize);
+    }
+
+
+    VBANPacketSender::~VBANPacketSender()
+    {
+        stop();
+    }
+
+
+    bool VBANPacketSender::start(const std::string& id, const std::vector<std::string>& endpoints, int port, bool broadcast, utility::ErrorState& errorState)
+    {
+        if (mRunning.load())
+            return true;
+
+        auto socket_state = std::make_unique<Socket>();
+        if (!utility::getVBANEndpointAddresses(endpoints, port, socket_state->mAddresses, id, errorState))
+            return false;
+
+        if (!utility::openVBANSendSocket(socket_state->mHandle, id, errorState))
+            return false;
+        mSocket = std::move(socket_state);
+
+        if (broadcast)
+        {
+            int const enable = 1;
+            if (!errorState.check(setsockopt(mSocket->mHandle, SOL_SOCKET, SO_BROADCAST, reinterpret_cast<const char*>(&enable), sizeof(enable)) == 0,
+                                  "%s: failed to enable broadcast: %s", id.c_str(), utility::getLastVBANSocketError().c_str()))
+            {
+                stop();
+                return false;
+            }
+        }
+
+        mRunning = true;
+        mThread = std::thread([this](){ run(); });
+        return true;
+    }
+
+
+    void VBANPacketSender::stop()
+    {
+        if (mRunning.exchange(false))
+        {
+            mQueue->wake();
+            if (mThread.joinable())
+                mThread.join();
+        }
+
+        if (mSocket != nullptr)
+        {
+            utility::closeVBANSocket(mSocket->mHandle);
+            mSocket = nullptr;
+        }
+    }
+
+
+    void VBANPacketSender::run()
+    {
+        VBANQueuedPacket packets[sBatchSize];
+        while (mRunning.load())
+        {
+            // only take out packets that are due, paced packets wait in the queue until their time has come
+            int64_t const now = VBANPacketQueue::getClockTime();
+            int const count = mQueue->pop(packets, sBatchSize, now);
+            if (count == 0)
+            {
+                int64_t due_time;
+                auto timeout = sWaitTimeout;
+                if (mQueue->getNextDueTime(due_time))
+                    timeout = std::min(timeout, std::chrono::microseconds(std::max<int64_t>(due_time - now, 0) / 1000));
+                mQueue->getWakeSignal().wait(timeout);
+                continue;
+            }
+
+            // send straight from the queue buffers to every endpoint, they are released once the kernel has copied them
+            for (int i = 0; i < count; i++)
+            {
+                for (const auto& address : mSocket->mAddresses)
+                {
+                    auto result = sendto(mSocket->mHandle, reinterpret_cast<const char*>(packets[i].mData), static_cast<int>(packets[i].mSize), 0,
+                                         reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+#ifndef _WIN32
+                    while (result < 0 && errno == EINTR)
+                        result = sendto(mSocket->mHandle, packets[i].mData, packets[i].mSize, 0, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+#endif
+                    if (result < 0)
+                        mSendErrors.add();
+                }
+            }
+            mQueue->release(packets, count);
+        }
+    }
+}
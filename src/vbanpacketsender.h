@@ -0,0 +1,84 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Nap includes
+#include <utility/errorstate.h>
+
+// Vban includes
+#include "vbanpacketqueue.h"
+
+// Std includes
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nap
+{
+    /**
+     * Sends the packets queued by a VBANSenderNode from a dedicated thread, so the audio thread only copies
+     * finished packets into a preallocated queue. When the network falls behind the oldest packets are dropped.
+     * The packets are sent to the endpoints from a socket of its own, straight out of the queue buffers:
+     * nothing is copied or allocated per packet.
+     */
+    class NAPAPI VBANPacketSender final
+    {
+    public:
+        /**
+         * Constructor, allocates the queue
+         * @param queueSize max number of packets waiting to be sent
+         * @param maxPacketSize max size of a packet in bytes
+         */
+        VBANPacketSender(int queueSize, size_t maxPacketSize);
+
+        /**
+         * Stops the sender thread
+         */
+        ~VBANPacketSender();
+
+        /**
+         * Opens the socket and starts the sender thread
+         * @param id identifies the sender in error messages
+         * @param endpoints IPv4 unicast, multicast or broadcast addresses every packet is sent to, as 'address' or 'address:port'
+         * @param port port of the endpoints that don't specify one
+         * @param broadcast allow sending to broadcast addresses
+         * @param errorState contains any errors
+         * @return true on success
+         */
+        bool start(const std::string& id, const std::vector<std::string>& endpoints, int port, bool broadcast, utility::ErrorState& errorState);
+
+        /**
+         * Stops the sender thread and closes the socket, packets that are still queued are not sent
+         */
+        void stop();
+
+        /**
+         * @return the queue the packets to send are pushed to, shared with the node producing them
+         */
+        const std::shared_ptr<VBANPacketQueue>& getQueue() const { return mQueue; }
+
+        /**
+         * @return number of packets taken out of the queue to be sent, can be called from any thread
+         */
+        uint64_t getSentCount() const { return mQueue->getSentCount(); }
+
+        /**
+         * @return number of packets the kernel refused, can be called from any thread
+         */
+        uint64_t getErrorCount() const { return mSendErrors.get(); }
+
+    private:
+        struct Socket;
+        void run();
+
+        std::unique_ptr<Socket> mSocket;        // Socket and addresses of the endpoints
+        std::shared_ptr<VBANPacketQueue> mQueue;
+        std::thread mThread;
+        std::atomic<bool> mRunning = { false };
+        VBANCounter mSendErrors;
+    };
+}
@@ -0,0 +1,503 @@
+#include "vbanpcmconvert.h"
+
+// Std includes
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define NAPVBAN_X86_64
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+#endif
+
+// AVX2 kernels are compiled for AVX2 but only executed when the CPU supports it
+#if defined(__GNUC__) || defined(__clang__)
+    #define NAPVBAN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define NAPVBAN_TARGET_AVX2
+#endif
+
+namespace nap
+{
+    namespace
+    {
+        using DecodeFunction = void(*)(const uint8_t* src, float* dst, int channelCount, int frameCount);
+        using EncodeFunction = void(*)(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount);
+
+        /**
+         * Conversion kernels for a specific instruction set
+         */
+        struct PCMKernels
+        {
+            const char* mName;
+            DecodeFunction mDecodeMono;
+            DecodeFunction mDecodeStereo;
+            DecodeFunction mDecodeWide;     // 8 or more channels
+            DecodeFunction mDecodeGeneric;
+            EncodeFunction mEncodeMono;
+            EncodeFunction mEncodeStereo;
+            EncodeFunction mEncodeWide;     // 8 or more channels
+            EncodeFunction mEncodeGeneric;
+        };
+
+        constexpr float sPCM16Scale = 1.0f / 32768.0f;
+        constexpr float sPCM16Min = -32768.0f;
+        constexpr float sPCM16Max = 32767.0f;
+
+
+        inline int16_t readPCM16(const uint8_t* src)
+        {
+            return static_cast<int16_t>(static_cast<uint16_t>(src[0]) | (static_cast<uint16_t>(src[1]) << 8));
+        }
+
+
+        /**
+         * Scalar conversion of frames [frameBegin, frameCount) of channels [channelBegin, channelEnd)
+         */
+        void decodePCM16Range(const uint8_t* src, float* dst, int channelCount, int frameCount, int frameBegin, int channelBegin, int channelEnd)
+        {
+            for (int f = frameBegin; f < frameCount; f++)
+            {
+                const uint8_t* frame = src + static_cast<size_t>(f) * channelCount * 2;
+                for (int c = channelBegin; c < channelEnd; c++)
+                    dst[static_cast<size_t>(c) * frameCount + f] = static_cast<float>(readPCM16(frame + c * 2)) * sPCM16Scale;
+            }
+        }
+
+
+        void decodePCM16Scalar(const uint8_t* src, float* dst, int channelCount, int frameCount)
+        {
+            decodePCM16Range(src, dst, channelCount, frameCount, 0, 0, channelCount);
+        }
+
+
+        inline void writePCM16(float sample, uint8_t* dst)
+        {
+            float scaled = sample * 32768.0f;
+            scaled = scaled < sPCM16Min ? sPCM16Min : (scaled > sPCM16Max ? sPCM16Max : scaled);
+            auto value = static_cast<uint16_t>(static_cast<int16_t>(std::lrintf(scaled)));
+            dst[0] = static_cast<uint8_t>(value & 0xff);
+            dst[1] = static_cast<uint8_t>(value >> 8);
+        }
+
+
+        /**
+         * Scalar conversion of frames [frameBegin, frameCount) of channels [channelBegin, channelEnd)
+         */
+        void encodePCM16Range(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount, int frameBegin, int channelBegin, int channelEnd)
+        {
+            for (int f = frameBegin; f < frameCount; f++)
+            {
+                uint8_t* frame = dst + static_cast<size_t>(f) * channelCount * 2;
+                for (int c = channelBegin; c < channelEnd; c++)
+                    writePCM16(src[c][srcOffset + f], frame + c * 2);
+            }
+        }
+
+
+        void encodePCM16Scalar(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount)
+        {
+            encodePCM16Range(src, srcOffset, dst, channelCount, frameCount, 0, 0, channelCount);
+        }
+
+
+#ifdef NAPVBAN_X86_64
+        /**
+         * Transposes an 8x8 matrix of 16 bit values, rows become columns
+         */
+        inline void transpose8x8Epi16(__m128i* rows)
+        {
+            __m128i a0 = _mm_unpacklo_epi16(rows[0], rows[1]);
+            __m128i a1 = _mm_unpackhi_epi16(rows[0], rows[1]);
+            __m128i a2 = _mm_unpacklo_epi16(rows[2], rows[3]);
+            __m128i a3 = _mm_unpackhi_epi16(rows[2], rows[3]);
+            __m128i a4 = _mm_unpacklo_epi16(rows[4], rows[5]);
+            __m128i a5 = _mm_unpackhi_epi16(rows[4], rows[5]);
+            __m128i a6 = _mm_unpacklo_epi16(rows[6], rows[7]);
+            __m128i a7 = _mm_unpackhi_epi16(rows[6], rows[7]);
+
+            __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+            __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+            __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+            __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+            __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+            __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+            __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+            __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+            rows[0] = _mm_unpacklo_epi64(b0, b4);
+            rows[1] = _mm_unpackhi_epi64(b0, b4);
+            rows[2] = _mm_unpacklo_epi64(b1, b5);
+            rows[3] = _mm_unpackhi_epi64(b1, b5);
+            rows[4] = _mm_unpacklo_epi64(b2, b6);
+            rows[5] = _mm_unpackhi_epi64(b2, b6);
+            rows[6] = _mm_unpacklo_epi64(b3, b7);
+            rows[7] = _mm_unpackhi_epi64(b3, b7);
+        }
+
+
+        /**
+         * Converts 8 signed 16 bit values to float and stores them unaligned
+         */
+        inline void storeEpi16AsFloatSSE2(__m128i values, float* dst, __m128 scale)
+        {
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16);
+            _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+
+
+        void decodePCM16MonoSSE2(const uint8_t* src, float* dst, int, int frameCount)
+        {
+            const __m128 scale = _mm_set1_ps(sPCM16Scale);
+            int f = 0;
+            for (; f + 8 <= frameCount; f += 8)
+            {
+                __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + f * 2));
+                storeEpi16AsFloatSSE2(values, dst + f, scale);
+            }
+            decodePCM16Range(src, dst, 1, frameCount, f, 0, 1);
+        }
+
+
+        void decodePCM16StereoSSE2(const uint8_t* src, float* dst, int, int frameCount)
+        {
+            const __m128 scale = _mm_set1_ps(sPCM16Scale);
+            float* left = dst;
+            float* right = dst + frameCount;
+            int f = 0;
+            for (; f + 4 <= frameCount; f += 4)
+            {
+                // every 32 bit lane holds one frame, left in the low half and right in the high half
+                __m128i frames = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + f * 4));
+                __m128i l = _mm_srai_epi32(_mm_slli_epi32(frames, 16), 16);
+                __m128i r = _mm_srai_epi32(frames, 16);
+                _mm_storeu_ps(left + f, _mm_mul_ps(_mm_cvtepi32_ps(l), scale));
+                _mm_storeu_ps(right + f, _mm_mul_ps(_mm_cvtepi32_ps(r), scale));
+            }
+            decodePCM16Range(src, dst, 2, frameCount, f, 0, 2);
+        }
+
+
+        void decodePCM16WideSSE2(const uint8_t* src, float* dst, int channelCount, int frameCount)
+        {
+            // blocks of 8 frames x 8 channels are transposed in registers
+            const __m128 scale = _mm_set1_ps(sPCM16Scale);
+            const int grouped_channels = (channelCount / 8) * 8;
+            const size_t frame_stride = static_cast<size_t>(channelCount) * 2;
+            __m128i rows[8];
+            int f = 0;
+            for (; f + 8 <= frameCount; f += 8)
+            {
+                const uint8_t* block = src + f * frame_stride;
+                for (int c = 0; c < grouped_channels; c += 8)
+                {
+                    for (int r = 0; r < 8; r++)
+                        rows[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + r * frame_stride + c * 2));
+                    transpose8x8Epi16(rows);
+                    for (int k = 0; k < 8; k++)
+                        storeEpi16AsFloatSSE2(rows[k], dst + static_cast<size_t>(c + k) * frameCount + f, scale);
+                }
+            }
+            decodePCM16Range(src, dst, channelCount, frameCount, f, 0, grouped_channels);
+            decodePCM16Range(src, dst, channelCount, frameCount, 0, grouped_channels, channelCount);
+        }
+
+
+        /**
+         * Scales, saturates and rounds 4 floats to 32 bit integers
+         */
+        inline __m128i quantizeSSE2(__m128 values)
+        {
+            __m128 scaled = _mm_mul_ps(values, _mm_set1_ps(32768.0f));
+            scaled = _mm_min_ps(_mm_max_ps(scaled, _mm_set1_ps(sPCM16Min)), _mm_set1_ps(sPCM16Max));
+            return _mm_cvtps_epi32(scaled);
+        }
+
+
+        void encodePCM16MonoSSE2(const float* const* src, int srcOffset, uint8_t* dst, int, int frameCount)
+        {
+            const float* samples = src[0] + srcOffset;
+            int f = 0;
+            for (; f + 8 <= frameCount; f += 8)
+            {
+                __m128i lo = quantizeSSE2(_mm_loadu_ps(samples + f));
+                __m128i hi = quantizeSSE2(_mm_loadu_ps(samples + f + 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + f * 2), _mm_packs_epi32(lo, hi));
+            }
+            encodePCM16Range(src, srcOffset, dst, 1, frameCount, f, 0, 1);
+        }
+
+
+        void encodePCM16StereoSSE2(const float* const* src, int srcOffset, uint8_t* dst, int, int frameCount)
+        {
+            const float* left = src[0] + srcOffset;
+            const float* right = src[1] + srcOffset;
+            int f = 0;
+            for (; f + 4 <= frameCount; f += 4)
+            {
+                __m128i l = quantizeSSE2(_mm_loadu_ps(left + f));
+                __m128i r = quantizeSSE2(_mm_loadu_ps(right + f));
+                __m128i frames = _mm_unpacklo_epi16(_mm_packs_epi32(l, l), _mm_packs_epi32(r, r));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + f * 4), frames);
+            }
+            encodePCM16Range(src, srcOffset, dst, 2, frameCount, f, 0, 2);
+        }
+
+
+        void encodePCM16WideSSE2(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount)
+        {
+            // blocks of 8 channels x 8 frames are transposed in registers
+            const int grouped_channels = (channelCount / 8) * 8;
+            const size_t frame_stride = static_cast<size_t>(channelCount) * 2;
+            __m128i rows[8];
+            int f = 0;
+            for (; f + 8 <= frameCount; f += 8)
+            {
+                uint8_t* block = dst + f * frame_stride;
+                for (int c = 0; c < grouped_channels; c += 8)
+                {
+                    for (int k = 0; k < 8; k++)
+                    {
+                        const float* samples = src[c + k] + srcOffset + f;
+                        rows[k] = _mm_packs_epi32(quantizeSSE2(_mm_loadu_ps(samples)), quantizeSSE2(_mm_loadu_ps(samples + 4)));
+                    }
+                    transpose8x8Epi16(rows);
+                    for (int r = 0; r < 8; r++)
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(block + r * frame_stride + c * 2), rows[r]);
+                }
+            }
+            encodePCM16Range(src, srcOffset, dst, channelCount, frameCount, f, 0, grouped_channels);
+            encodePCM16Range(src, srcOffset, dst, channelCount, frameCount, 0, grouped_channels, channelCount);
+        }
+
+
+        NAPVBAN_TARGET_AVX2 void decodePCM16MonoAVX2(const uint8_t* src, float* dst, int, int frameCount)
+        {
+            const __m256 scale = _mm256_set1_ps(sPCM16Scale);
+            int f = 0;
+            for (; f + 16 <= frameCount; f += 16)
+            {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + f * 2));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + f * 2 + 16));
+                _mm256_storeu_ps(dst + f, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)), scale));
+                _mm256_storeu_ps(dst + f + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b)), scale));
+            }
+            decodePCM16Range(src, dst, 1, frameCount, f, 0, 1);
+        }
+
+
+        NAPVBAN_TARGET_AVX2 void decodePCM16StereoAVX2(const uint8_t* src, float* dst, int, int frameCount)
+        {
+            const __m256 scale = _mm256_set1_ps(sPCM16Scale);
+            float* left = dst;
+            float* right = dst + frameCount;
+            int f = 0;
+            for (; f + 8 <= frameCount; f += 8)
+            {
+                __m256i frames = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + f * 4));
+                __m256i l = _mm256_srai_epi32(_mm256_slli_epi32(frames, 16), 16);
+                __m256i r = _mm256_srai_epi32(frames, 16);
+                _mm256_storeu_ps(left + f, _mm256_mul_ps(_mm256_cvtepi32_ps(l), scale));
+                _mm256_storeu_ps(right + f, _mm256_mul_ps(_mm256_cvtepi32_ps(r), scale));
+            }
+            decodePCM16Range(src, dst, 2, frameCount, f, 0, 2);
+        }
+
+
+        NAPVBAN_TARGET_AVX2 void decodePCM16WideAVX2(const uint8_t* src, float* dst, int channelCount, int frameCount)
+        {
+            const __m256 scale = _mm256_set1_ps(sPCM16Scale);
+            const int grouped_channels = (channelCount / 8) * 8;
+            const size_t frame_stride = static_cast<size_t>(channelCount) * 2;
+            __m128i rows[8];
+            int f = 0;
+            for (; f + 8 <= frameCount; f += 8)
+            {
+                const uint8_t* block = src + f * frame_stride;
+                for (int c = 0; c < grouped_channels; c += 8)
+                {
+                    for (int r = 0; r < 8; r++)
+                        rows[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + r * frame_stride + c * 2));
+                    transpose8x8Epi16(rows);
+                    for (int k = 0; k < 8; k++)
+                    {
+                        __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(rows[k]));
+                        _mm256_storeu_ps(dst + static_cast<size_t>(c + k) * frameCount + f, _mm256_mul_ps(values, scale));
+                    }
+                }
+            }
+            decodePCM16Range(src, dst, channelCount, frameCount, f, 0, grouped_channels);
+            decodePCM16Range(src, dst, channelCount, frameCount, 0, grouped_channels, channelCount);
+        }
+
+
+        NAPVBAN_TARGET_AVX2 inline __m256i quantizeAVX2(__m256 values)
+        {
+            __m256 scaled = _mm256_mul_ps(values, _mm256_set1_ps(32768.0f));
+            scaled = _mm256_min_ps(_mm256_max_ps(scaled, _mm256_set1_ps(sPCM16Min)), _mm256_set1_ps(sPCM16Max));
+            return _mm256_cvtps_epi32(scaled);
+        }
+
+
+        NAPVBAN_TARGET_AVX2 void encodePCM16MonoAVX2(const float* const* src, int srcOffset, uint8_t* dst, int, int frameCount)
+        {
+            const float* samples = src[0] + srcOffset;
+            int f = 0;
+            for (; f + 16 <= frameCount; f += 16)
+            {
+                __m256i a = quantizeAVX2(_mm256_loadu_ps(samples + f));
+                __m256i b = quantizeAVX2(_mm256_loadu_ps(samples + f + 8));
+
+                // packing works per 128 bit lane, restore the sample order afterwards
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + f * 2), packed);
+            }
+            encodePCM16Range(src, srcOffset, dst, 1, frameCount, f, 0, 1);
+        }
+
+
+        NAPVBAN_TARGET_AVX2 void encodePCM16StereoAVX2(const float* const* src, int srcOffset, uint8_t* dst, int, int frameCount)
+        {
+            const float* left = src[0] + srcOffset;
+            const float* right = src[1] + srcOffset;
+            int f = 0;
+            for (; f + 8 <= frameCount; f += 8)
+            {
+                __m256i l = quantizeAVX2(_mm256_loadu_ps(left + f));
+                __m256i r = quantizeAVX2(_mm256_loadu_ps(right + f));
+
+                // interleaving and packing both work per 128 bit lane, which keeps the frames in order
+                __m256i lo = _mm256_unpacklo_epi32(l, r);
+                __m256i hi = _mm256_unpackhi_epi32(l, r);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + f * 4), _mm256_packs_epi32(lo, hi));
+            }
+            encodePCM16Range(src, srcOffset, dst, 2, frameCount, f, 0, 2);
+        }
+
+
+        NAPVBAN_TARGET_AVX2 void encodePCM16WideAVX2(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount)
+        {
+            const int grouped_channels = (channelCount / 8) * 8;
+            const size_t frame_stride = static_cast<size_t>(channelCount) * 2;
+            __m128i rows[8];
+            int f = 0;
+            for (; f + 8 <= frameCount; f += 8)
+            {
+                uint8_t* block = dst + f * frame_stride;
+                for (int c = 0; c < grouped_channels; c += 8)
+                {
+                    for (int k = 0; k < 8; k++)
+                    {
+                        __m256i values = quantizeAVX2(_mm256_loadu_ps(src[c + k] + srcOffset + f));
+                        rows[k] = _mm_packs_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+                    }
+                    transpose8x8Epi16(rows);
+                    for (int r = 0; r < 8; r++)
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(block + r * frame_stride + c * 2), rows[r]);
+                }
+            }
+            encodePCM16Range(src, srcOffset, dst, channelCount, frameCount, f, 0, grouped_channels);
+            encodePCM16Range(src, srcOffset, dst, channelCount, frameCount, 0, grouped_channels, channelCount);
+        }
+
+
+        bool cpuSupportsAVX2()
+        {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+
+            // the OS has to save the AVX registers on context switches
+            __cpuid(info, 1);
+            bool const os_xsave = (info[2] & (1 << 27)) != 0;
+            bool const avx = (info[2] & (1 << 28)) != 0;
+            if (!os_xsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+                return false;
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+#endif // NAPVBAN_X86_64
+
+
+        PCMKernels selectKernels()
+        {
+#ifdef NAPVBAN_X86_64
+            if (cpuSupportsAVX2())
+                return { "AVX2", decodePCM16MonoAVX2, decodePCM16StereoAVX2, decodePCM16WideAVX2, decodePCM16Scalar,
+                         encodePCM16MonoAVX2, encodePCM16StereoAVX2, encodePCM16WideAVX2, encodePCM16Scalar };
+
+            // SSE2 is part of the x86-64 baseline
+            return { "SSE2", decodePCM16MonoSSE2, decodePCM16StereoSSE2, decodePCM16WideSSE2, decodePCM16Scalar,
+                     encodePCM16MonoSSE2, encodePCM16StereoSSE2, encodePCM16WideSSE2, encodePCM16Scalar };
+#else
+            return { "Scalar", decodePCM16Scalar, decodePCM16Scalar, decodePCM16Scalar, decodePCM16Scalar,
+                     encodePCM16Scalar, encodePCM16Scalar, encodePCM16Scalar, encodePCM16Scalar };
+#endif
+        }
+
+
+        const PCMKernels& getKernels()
+        {
+            static const PCMKernels kernels = selectKernels();
+            return kernels;
+        }
+    }
+
+
+    void utility::decodePCM16(const uint8_t* src, float* dst, int channelCount, int frameCount)
+    {
+        const PCMKernels& kernels = getKernels();
+        switch (channelCount)
+        {
+        case 1:
+            kernels.mDecodeMono(src, dst, channelCount, frameCount);
+            break;
+        case 2:
+            kernels.mDecodeStereo(src, dst, channelCount, frameCount);
+            break;
+        default:
+            if (channelCount >= 8)
+                kernels.mDecodeWide(src, dst, channelCount, frameCount);
+            else
+                kernels.mDecodeGeneric(src, dst, channelCount, frameCount);
+            break;
+        }
+    }
+
+
+    void utility::encodePCM16(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount)
+    {
+        const PCMKernels& kernels = getKernels();
+        switch (channelCount)
+        {
+        case 1:
+            kernels.mEncodeMono(src, srcOffset, dst, channelCount, frameCount);
+            break;
+        case 2:
+            kernels.mEncodeStereo(src, srcOffset, dst, channelCount, frameCount);
+            break;
+        default:
+            if (channelCount >= 8)
+                kernels.mEncodeWide(src, srcOffset, dst, channelCount, frameCount);
+            else
+                kernels.mEncodeGeneric(src, srcOffset, dst, channelCount, frameCount);
+            break;
+        }
+    }
+
+
+    const char* utility::getPCMConvertInstructionSet()
+    {
+        return getKernels().mName;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// Std includes
+#include <stdint.h>
+#include <stddef.h>
+
+namespace nap
+{
+    namespace utility
+    {
+        /**
+         * Converts interleaved little endian 16 bit PCM frames into planar floating point data.
+         * The samples of channel c are written to dst + c * frameCount.
+         * On first use the fastest implementation supported by the CPU is selected (AVX2, SSE2 or scalar),
+         * with specialized kernels for mono, stereo and layouts of 8 or more channels.
+         * @param src interleaved 16 bit PCM data, frameCount * channelCount samples
+         * @param dst planar output, must hold frameCount * channelCount floats
+         * @param channelCount number of interleaved channels
+         * @param frameCount number of samples per channel
+         */
+        void decodePCM16(const uint8_t* src, float* dst, int channelCount, int frameCount);
+
+        /**
+         * Converts planar floating point data into interleaved little endian 16 bit PCM frames.
+         * Samples are scaled by 32768, rounded to the nearest integer and saturated to the 16 bit range,
+         * so full scale +1.0 becomes 32767 instead of wrapping around.
+         * Uses the same runtime selected instruction set as decodePCM16.
+         * @param src pointer to the sample data of every channel
+         * @param srcOffset index of the first sample to read from every channel
+         * @param dst interleaved output, must hold frameCount * channelCount * 2 bytes
+         * @param channelCount number of channels
+         * @param frameCount number of samples per channel to convert
+         */
+        void encodePCM16(const float* const* src, int srcOffset, uint8_t* dst, int channelCount, int frameCount);
+
+        /**
+         * @return name of the instruction set the PCM conversion kernels use on this CPU
+         */
+        const char* getPCMConvertInstructionSet();
+    }
+}
@@ -6,11 +6,18 @@
 #include <vbanstreamsendercomponent.h>
 #include <vban/vban.h>
 #include <vbanutils.h>
+#include <vbancodec.h>
+#include <vbanlosslesscodec.h>
 
 #include <audio/core/audionodemanager.h>
 
 #include <nap/logger.h>
 
+// Std includes
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
 RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::audio::VBANSenderNode)
 		RTTI_PROPERTY("input", &nap::audio::VBANSenderNode::inputs, nap::rtti::EPropertyMetaData::Embedded)
 RTTI_END_CLASS
@@ -20,12 +27,35 @@ namespace nap
 {
 	namespace audio
 	{
+        // Returns true when no sample in the range exceeds the threshold, stops at the first sample that does
+        static bool isSilent(const float* const* channels, int channelCount, int offset, int frameCount, float threshold)
+        {
+            for (int channel = 0; channel < channelCount; channel++)
+            {
+                const float* samples = channels[channel] + offset;
+                for (int i = 0; i < frameCount; i++)
+                {
+                    if (std::fabs(samples[i]) > threshold)
+                        return false;
+                }
+            }
+            return true;
+        }
+
 
-		VBANSenderNode::VBANSenderNode(NodeManager& nodeManager) : Node(nodeManager)
+		VBANSenderNode::VBANSenderNode(NodeManager& nodeManager, int channelCount) : Node(nodeManager)
         {
-            getNodeManager().registerRootProcess(*this);
-            mInputPullResult.reserve(2);
+            // preallocate the layout for every grouping of the channels, at most one stream per channel
+            int const max_streams = std::max(1, channelCount);
+            mInputPullResult.reserve(channelCount);
+            mChannelData.resize(channelCount);
+            mStreamPackets.resize(max_streams);
+            for (auto& packet : mStreamPackets)
+                packet.mBuffer.reserve(VBAN_PROTOCOL_MAX_SIZE);
+            mCompressedPacket.resize(VBAN_PROTOCOL_MAX_SIZE);
+            mCodec = utility::getVBANCodec(VBAN_BITFMT_16_INT);
             sampleRateChanged(nodeManager.getSampleRate());
+            getNodeManager().registerRootProcess(*this);
 		}
 
 
@@ -37,7 +67,7 @@ namespace nap
 
 		void VBANSenderNode::process()
 		{
-            if (mUDPClient == nullptr)
+            if (mPacketQueue == nullptr)
                 return;
 
             if (mStreamName.empty())
@@ -47,49 +77,232 @@ namespace nap
 
 			// get output buffers
 			inputs.pull(mInputPullResult);
-            setChannelCount(mInputPullResult.size());
+            updatePacketLayout(mInputPullResult.size());
+            if (mChannelCount == 0 || mPacketFrames == 0)
+                return;
+
+            for (auto channel = 0; channel < mChannelCount; ++channel)
+                mChannelData[channel] = mInputPullResult[channel]->data();
 
-            for (auto i = 0; i < getBufferSize(); ++i)
+            // encode the block in runs that end at packet boundaries
+            int const buffer_size = getBufferSize();
+            int frame = 0;
+            uint32_t const first_frame_counter = mFrameCounter;
+
+            // paced packets are due relative to the first packet completed in this block
+            int64_t const block_time = mPacing || mLatencyMonitor != nullptr ? VBANPacketQueue::getClockTime() : 0;
+            int first_packet_frame = -1;
+            while (frame < buffer_size)
             {
-                for (auto channel = 0; channel < mChannelCount; ++channel)
+                int const frames = std::min(buffer_size - frame, mPacketFrames - mPacketWritten);
+                if (mPacketWritten == 0)
+                    mPacketStartTime = block_time;
+
+                // convert float to PCM of the configured bit resolution, directly into the packet of every stream
+                for (int stream = 0; stream < mStreamCount; stream++)
                 {
-                    float sample = (*mInputPullResult[channel])[i];
+                    auto& packet = mStreamPackets[stream];
+                    nap::uint8* destination = &packet.mBuffer[VBAN_HEADER_SIZE + mPacketWritten * packet.mFrameSize];
+                    mCodec->mEncode(&mChannelData[packet.mFirstChannel], frame, destination, packet.mChannelCount, frames);
+                }
 
-                    // convert float to short
-                    short value = static_cast<short>(sample * 32768.0f);
+                // only scanned until the first sample above the threshold, a packet with audio is hardly checked
+                if (mSilenceSuppression && mPacketSilent)
+                    mPacketSilent = isSilent(mChannelData.data(), mChannelCount, frame, frames, mSilenceThreshold);
+                mPacketWritten += frames;
+                frame += frames;
 
-                    // convert short to two bytes
-                    char byte_1 = value;
-                    char byte_2 = value >> 8;
+                assert(mPacketWritten <= mPacketFrames);
+                if (mPacketWritten == mPacketFrames)
+                    flushPacket(getDueTime(block_time, frame, first_packet_frame));
+            }
 
-                    // copy sample bytes to packet
-                    mPacketBuffer[mPacketWritePosition] = byte_1;
-                    mPacketBuffer[mPacketWritePosition + 1] = byte_2;
-                    mPacketWritePosition += 2;
-                }
+            // when aligned, the samples of this block don't wait for the next one
+            if (mAlignToBufferSize && mPacketWritten > 0)
+                flushPacket(getDueTime(block_time, frame, first_packet_frame));
+
+            // wake up the sender thread once per block, the frame counter advances with every packet queued
+            if (mFrameCounter != first_frame_counter)
+                mPacketQueue->wake();
+		}
 
-                assert(mPacketWritePosition <= mPacketSize);
-                if (mPacketWritePosition == mPacketSize)
-                {
-                    // set the frame counter in the VBAN header
-                    mPacketHeader->nuFrame = mFrameCounter;
 
-                    // create udp packet & send
-                    UDPPacket packet(mPacketBuffer); // We deep copy the packet because we will reuse the buffer
-                    mUDPClient->send(packet);
+        void VBANSenderNode::setBitResolution(EVBANBitResolution resolution)
+        {
+            const VBANCodec* codec = utility::getVBANCodec(static_cast<VBanBitResolution>(resolution));
+            assert(codec != nullptr);
+            getNodeManager().enqueueTask([&, codec]()
+            {
+                // force the packet layout to be rebuilt for the new sample size
+                mCodec = codec;
+                mChannelCount = 0;
+            });
+        }
 
-                    // reset udp buffer write position
-                    mPacketWritePosition = VBAN_HEADER_SIZE;
 
-                    // advance framecount
-                    mFrameCounter++;
+        void VBANSenderNode::setSamplesPerFrame(int samplesPerFrame, bool alignToBufferSize)
+        {
+            samplesPerFrame = std::max(1, std::min(samplesPerFrame, VBAN_SAMPLES_MAX_NB));
+            getNodeManager().enqueueTask([&, samplesPerFrame, alignToBufferSize]()
+            {
+                // force the packet layout to be rebuilt for the new packet size
+                mSamplesPerFrame = samplesPerFrame;
+                mAlignToBufferSize = alignToBufferSize;
+                mChannelCount = 0;
+            });
+        }
+
+
+        void VBANSenderNode::setMaxChannelsPerStream(int channelCount)
+        {
+            channelCount = std::max(1, std::min(channelCount, 254));
+            getNodeManager().enqueueTask([&, channelCount]()
+            {
+                // force the packet layout to be rebuilt for the new grouping
+                mMaxChannelsPerStream = channelCount;
+                mChannelCount = 0;
+            });
+        }
+
+
+        void VBANSenderNode::setSilenceSuppression(bool enable, float threshold, float hangover, float keepAliveInterval)
+        {
+            getNodeManager().enqueueTask([&, enable, threshold, hangover, keepAliveInterval]()
+            {
+                mSilenceSuppression = enable;
+                mSilenceThreshold = std::max(threshold, 0.0f);
+                mSilenceHangover = std::max(hangover, 0.0f);
+                mKeepAliveInterval = std::max(keepAliveInterval, 0.0f);
+                mPacketSilent = true;
+                mSuppressing = false;
+                mSilentFrames = 0;
+                mKeepAliveFrames = 0;
+            });
+        }
+
+
+        int VBANSenderNode::getStreamCount(int channelCount, int maxChannelsPerStream)
+        {
+            return std::max(1, (channelCount + maxChannelsPerStream - 1) / maxChannelsPerStream);
+        }
+
+
+        int VBANSenderNode::getStreamChannelCount(int channelCount, int maxChannelsPerStream)
+        {
+            // the channels are split evenly over the streams, the first streams get the remaining channels
+            int const stream_count = getStreamCount(channelCount, maxChannelsPerStream);
+            return (channelCount + stream_count - 1) / stream_count;
+        }
+
+
+        int64_t VBANSenderNode::getDueTime(int64_t blockTime, int frame, int& firstPacketFrame) const
+        {
+            if (!mPacing)
+                return 0;
+            if (firstPacketFrame < 0)
+                firstPacketFrame = frame;
+            return blockTime + static_cast<int64_t>((frame - firstPacketFrame) * mFrameDuration);
+        }
+
+
+        void VBANSenderNode::flushPacket(int64_t dueTime)
+        {
+            if (mSilenceSuppression && suppressPacket(dueTime))
+                return;
+
+            // the packets of all streams share the frame counter, a packet can hold fewer samples than the layout
+            // in which case the header announces the actual count
+            for (int stream = 0; stream < mStreamCount; stream++)
+            {
+                auto& packet = mStreamPackets[stream];
+                VBanHeader* header = packet.getHeader();
+                header->nuFrame = mFrameCounter;
+                header->format_nbs = mPacketWritten - 1;
+
+                // send the compressed payload instead when it is smaller, the header still describes the PCM it decompresses to.
+                // The resolution is taken from the header, a packet flushed on a layout change was encoded with the previous codec
+                const nap::uint8* data = packet.mBuffer.data();
+                size_t size = VBAN_HEADER_SIZE + static_cast<size_t>(mPacketWritten) * packet.mFrameSize;
+                auto const resolution = static_cast<VBanBitResolution>(header->format_bit & VBAN_BIT_RESOLUTION_MASK);
+                if (mCompression && utility::isLosslessSupported(resolution))
+                {
+                    size_t const compressed_size = utility::encodeLossless(&packet.mBuffer[VBAN_HEADER_SIZE], resolution,
+                                                                           packet.mChannelCount, mPacketWritten,
+                                                                           &mCompressedPacket[VBAN_HEADER_SIZE], size - VBAN_HEADER_SIZE - 1);
+                    if (compressed_size > 0)
+                    {
+                        std::memcpy(mCompressedPacket.data(), packet.mBuffer.data(), VBAN_HEADER_SIZE);
+                        reinterpret_cast<VBanHeader*>(mCompressedPacket.data())->format_bit |= VBAN_CODEC_USER;
+                        data = mCompressedPacket.data();
+                        size = VBAN_HEADER_SIZE + compressed_size;
+                    }
                 }
+
+                // copy into the preallocated queue, we reuse the buffer, the sender thread sends it
+                mPacketQueue->push(data, size, dueTime);
+                header->format_nbs = mPacketFrames - 1;
             }
-		}
+
+            if (mLatencyMonitor != nullptr)
+                mLatencyMonitor->packetSent(mFrameCounter, mPacketStartTime);
+
+            // reset write position and advance framecount
+            mPacketWritten = 0;
+            mFrameCounter++;
+        }
+
+
+        bool VBANSenderNode::suppressPacket(int64_t dueTime)
+        {
+            bool const silent = mPacketSilent;
+            mPacketSilent = true;
+            if (!silent)
+            {
+                mSilentFrames = 0;
+                mSuppressing = false;
+                return false;
+            }
+
+            // the hangover keeps short pauses and the decay of a sound intact
+            mSilentFrames += mPacketWritten;
+            if (mSilentFrames * mFrameDuration <= mSilenceHangover * 1e6)
+                return false;
+
+            // announce the silence when the suppression starts, and repeat that every keep-alive interval
+            mKeepAliveFrames += mPacketWritten;
+            if (!mSuppressing || mKeepAliveFrames * mFrameDuration >= mKeepAliveInterval * 1e6)
+            {
+                sendSilenceDescriptor(dueTime);
+                mKeepAliveFrames = 0;
+            }
+            mSuppressing = true;
+            mSuppressedPackets.add();
+            mPacketWritten = 0;
+            return true;
+        }
+
+
+        void VBANSenderNode::sendSilenceDescriptor(int64_t dueTime)
+        {
+            // the header still describes the suppressed packets, so receivers don't see a format change
+            for (int stream = 0; stream < mStreamCount; stream++)
+            {
+                std::memcpy(mSilenceDescriptor.data(), mStreamPackets[stream].mBuffer.data(), VBAN_HEADER_SIZE);
+                VBanHeader* header = reinterpret_cast<VBanHeader*>(mSilenceDescriptor.data());
+                header->nuFrame = mFrameCounter;
+                header->format_bit |= VBAN_CODEC_USER;
+                mSilenceDescriptor[VBAN_HEADER_SIZE] = VBAN_SILENCE_DESCRIPTOR_TAG;
+                mPacketQueue->push(mSilenceDescriptor.data(), mSilenceDescriptor.size(), dueTime);
+            }
+            mFrameCounter++;
+        }
 
 
         void VBANSenderNode::sampleRateChanged(float sampleRate)
         {
+            // used to pace packets
+            mFrameDuration = 1e9 / sampleRate;
+
             // acquire sample rate format
             utility::ErrorState errorState;
             if (!utility::getVBANSampleRateFormatFromSampleRate(mSampleRateFormat,
@@ -102,47 +315,70 @@ namespace nap
         }
 
 
-        void VBANSenderNode::setChannelCount(int channelCount)
+        void VBANSenderNode::updatePacketLayout(int channelCount)
         {
-            // sanity check the amount of channels
-            if(channelCount > 254)
+            // the storage is allocated for the channel count passed on construction, extra inputs are not sent
+            assert(channelCount <= mChannelData.size());
+            channelCount = std::min(channelCount, static_cast<int>(mChannelData.size()));
+            if (mChannelCount != channelCount || (mAlignToBufferSize && mLayoutBufferSize != getBufferSize()))
             {
-                nap::Logger::warn("Channel count %i not allowed, clamping to 254", channelCount);
-                mChannelCount = 254;
-            }
+                // send the samples encoded with the old layout, the headers still describe them
+                if (mPacketFrames > 0 && mPacketWritten > 0)
+                    flushPacket(0);
 
-            if (mChannelCount != channelCount)
-            {
                 mChannelCount = channelCount;
+                mStreamCount = 0;
+                mPacketFrames = 0;
+                mPacketWritten = 0;
+                if (mChannelCount == 0)
+                    return;
+
+                // samples per channel, limited so the total buffersize of the widest stream does not exceed the max data size
+                int const stream_count = getStreamCount(mChannelCount, mMaxChannelsPerStream);
+                int const sample_size = mCodec->mSampleSize;
+                int const max_frames = std::min(mSamplesPerFrame, VBAN_DATA_MAX_SIZE / (getStreamChannelCount(mChannelCount, mMaxChannelsPerStream) * sample_size));
+
+                // not even a single frame fits in a packet, rejected by VBANStreamSenderComponentInstance::init()
+                if (max_frames == 0)
+                    return;
+
+                // split the audio buffer evenly over as few packets as possible
+                int frames = max_frames;
+                if (mAlignToBufferSize)
+                {
+                    mLayoutBufferSize = getBufferSize();
+                    int const packets = (mLayoutBufferSize + max_frames - 1) / max_frames;
+                    frames = (mLayoutBufferSize + packets - 1) / packets;
+                }
+                mPacketFrames = frames;
+                mStreamCount = stream_count;
 
-                // buffer size for each channel
-                mPacketChannelSize = VBAN_SAMPLES_MAX_NB * 2;
-
-                // if total buffersize exceeds max data size, resize packet channel size to fit max data size
-                if (mPacketChannelSize * mChannelCount > VBAN_DATA_MAX_SIZE)
-                    mPacketChannelSize = (VBAN_DATA_MAX_SIZE / (mChannelCount * 2)) * 2;
-
-                // compute the buffer size of all channels together
-                int total_buffer_size = mPacketChannelSize * mChannelCount;
-
-                // resize the packet data to have the correct size
-                mPacketBuffer.resize(VBAN_HEADER_SIZE + total_buffer_size);
-
-                // set write position
-                mPacketWritePosition = VBAN_HEADER_SIZE;
-
-                // set packet size
-                mPacketSize = mPacketChannelSize * mChannelCount + VBAN_HEADER_SIZE;
-
-                // initialize VBAN header
-                mPacketHeader = (struct VBanHeader*)(&mPacketBuffer[0]);
-                mPacketHeader->vban       = *(int32_t*)("VBAN");
-                mPacketHeader->format_nbc = mChannelCount - 1;
-                mPacketHeader->format_SR  = mSampleRateFormat;
-                mPacketHeader->format_bit = VBAN_BITFMT_16_INT;
-                strncpy(mPacketHeader->streamname, mStreamName.c_str(), VBAN_STREAM_NAME_SIZE - 1);
-                mPacketHeader->nuFrame    = mFrameCounter;
-                mPacketHeader->format_nbs = (mPacketChannelSize / 2) - 1;
+                // initialize the packet and VBAN header of every stream, the buffers are reserved for the largest packet
+                int first_channel = 0;
+                for (int stream = 0; stream < stream_count; stream++)
+                {
+                    auto& packet = mStreamPackets[stream];
+                    packet.mFirstChannel = first_channel;
+                    packet.mChannelCount = mChannelCount / stream_count + (stream < mChannelCount % stream_count ? 1 : 0);
+                    packet.mFrameSize = packet.mChannelCount * sample_size;
+                    packet.mBuffer.resize(VBAN_HEADER_SIZE + static_cast<size_t>(mPacketFrames) * packet.mFrameSize);
+                    first_channel += packet.mChannelCount;
+
+                    // sibling streams are named after the stream with the index of the group appended
+                    VBanHeader* header = packet.getHeader();
+                    header->vban       = *(int32_t*)("VBAN");
+                    header->format_nbc = packet.mChannelCount - 1;
+                    header->format_SR  = mSampleRateFormat;
+                    header->format_bit = mCodec->mResolution;
+                    char name[VBAN_STREAM_NAME_SIZE + 1];
+                    if (stream_count > 1)
+                        std::snprintf(name, sizeof(name), "%s_%i", mStreamName.c_str(), stream);
+                    else
+                        std::snprintf(name, sizeof(name), "%s", mStreamName.c_str());
+                    strncpy(header->streamname, name, VBAN_STREAM_NAME_SIZE); // name may fill the complete field without terminator
+                    header->nuFrame    = mFrameCounter;
+                    header->format_nbs = mPacketFrames - 1;
+                }
             }
         }
 	}
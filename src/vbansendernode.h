@@ -5,11 +5,16 @@
 #pragma once
 
 // Std includes
+#include <array>
 #include <atomic>
+#include <memory>
 
 #include <vban/vban.h>
-
-#include <udpclient.h>
+#include <vbancodec.h>
+#include <vbanlatencymonitor.h>
+#include <vbanpacketqueue.h>
+#include <vbanstatistics.h>
+#include <vbanutils.h>
 
 // Audio includes
 #include <audio/core/audionode.h>
@@ -32,7 +37,13 @@ namespace nap
 			RTTI_ENABLE(Node)
 
         public:
-			VBANSenderNode(NodeManager& nodeManager);
+            /**
+             * The packet layout is allocated up front for the given number of input channels,
+             * so the audio thread does not allocate when the layout changes.
+             * @param nodeManager the node manager
+             * @param channelCount max number of input channels, inputs beyond that are not sent
+             */
+			VBANSenderNode(NodeManager& nodeManager, int channelCount);
 
 			virtual ~VBANSenderNode();
 
@@ -41,30 +52,155 @@ namespace nap
              */
 			MultiInputPin inputs = {this};
 
-            void setUDPClient(UDPClient* client) { getNodeManager().enqueueTask([&, client](){ mUDPClient = client; }); }
+            /**
+             * Sets the queue finished packets are pushed to, the audio thread never sends packets itself.
+             * Pass nullptr to stop sending.
+             * @param queue the packet queue, emptied by a VBANPacketSender
+             */
+            void setPacketQueue(std::shared_ptr<VBANPacketQueue> queue) { getNodeManager().enqueueTask([&, queue](){ mPacketQueue = queue; }); }
             void setStreamName(const std::string& name) { getNodeManager().enqueueTask([&, name](){ mStreamName = name; }); }
 
+            /**
+             * Sets the PCM bit resolution of the outgoing packets, 16 bit by default
+             * @param resolution the bit resolution
+             */
+            void setBitResolution(EVBANBitResolution resolution);
+
+            /**
+             * Sets the number of samples per channel in every packet, VBAN_SAMPLES_MAX_NB by default.
+             * Fewer samples per packet lower the latency, at the cost of more packets and header overhead.
+             * The count is clamped so a packet does not exceed the max VBAN packet size.
+             * @param samplesPerFrame max number of samples per channel in a packet, 1 to VBAN_SAMPLES_MAX_NB
+             * @param alignToBufferSize when true, the audio buffer is split evenly over as few packets as possible and
+             * the last packet of every buffer is sent immediately, so no samples wait for the next audio callback
+             */
+            void setSamplesPerFrame(int samplesPerFrame, bool alignToBufferSize);
+
+            /**
+             * Sets the max number of channels in a single VBAN stream, 254 by default.
+             * Wider inputs are split evenly into groups of consecutive channels that are sent as sibling streams,
+             * named after the stream with the index of the group appended: 'name_0', 'name_1' etc.
+             * The packets of all sibling streams cover the same samples and carry the same frame counter,
+             * so a receiver can assemble them sample aligned, see VBANStreamPlayerComponent::StreamCount.
+             * @param channelCount max number of channels per stream, 1 to 254
+             */
+            void setMaxChannelsPerStream(int channelCount);
+
+            /**
+             * Returns the number of streams the given number of channels is split into
+             * @param channelCount total number of channels
+             * @param maxChannelsPerStream max number of channels per stream
+             * @return number of sibling streams
+             */
+            static int getStreamCount(int channelCount, int maxChannelsPerStream);
+
+            /**
+             * Returns the number of channels in the widest stream the given number of channels is split into
+             * @param channelCount total number of channels
+             * @param maxChannelsPerStream max number of channels per stream
+             * @return number of channels in the widest sibling stream
+             */
+            static int getStreamChannelCount(int channelCount, int maxChannelsPerStream);
+
+            /**
+             * Enables pacing, off by default. Without pacing all packets completed in an audio callback are sent
+             * back to back. With pacing every packet gets a due time derived from the position of its last sample
+             * in the audio buffer and the sample rate, spreading the packets of a buffer evenly over the audio period.
+             * The first packet of a buffer is due immediately, so pacing adds at most one audio period minus one packet of latency.
+             * @param enable if pacing is enabled
+             */
+            void setPacing(bool enable) { getNodeManager().enqueueTask([&, enable](){ mPacing = enable; }); }
+
+            /**
+             * Reports every packet queued for sending to a latency monitor, pass nullptr to stop reporting.
+             * @param monitor the monitor, has to outlive the node
+             */
+            void setLatencyMonitor(VBANLatencyMonitor* monitor) { getNodeManager().enqueueTask([&, monitor](){ mLatencyMonitor = monitor; }); }
+
+            /**
+             * Enables lossless compression, off by default. Every packet is compressed on its own and sent with the
+             * VBAN_CODEC_USER codec when that makes it smaller, otherwise it is sent as PCM. Only 8, 16 and 24 bit
+             * integer resolutions are compressed, see utility::encodeLossless().
+             * @param enable if compression is enabled
+             */
+            void setCompression(bool enable) { getNodeManager().enqueueTask([&, enable](){ mCompression = enable; }); }
+
+            /**
+             * Enables silence suppression (discontinuous transmission), off by default. A packet is silent when none of
+             * its samples exceeds the threshold. Once the stream has been silent for longer than the hangover, silent
+             * packets are not sent anymore. Instead a silence descriptor is sent when the suppression starts and then
+             * once every keep-alive interval, receivers play silence until audio packets arrive again.
+             * Only sent packets and descriptors advance the frame counter, so receivers don't consider suppressed packets lost.
+             * @param enable if silence suppression is enabled
+             * @param threshold peak amplitude at or below which a packet is silent, 0 only suppresses digital silence
+             * @param hangover time in milliseconds silent packets are still sent before suppression starts, keeps short pauses intact
+             * @param keepAliveInterval time in milliseconds between silence descriptors while packets are suppressed
+             */
+            void setSilenceSuppression(bool enable, float threshold, float hangover, float keepAliveInterval);
+
+            /**
+             * @return number of silent packets that were not sent because of silence suppression, can be called from any thread
+             */
+            uint64_t getSuppressedPacketCount() const { return mSuppressedPackets.get(); }
+
 		private:
-            void setChannelCount(int channelCount);
+            /**
+             * Packet of a single stream, holding a group of consecutive input channels
+             */
+            struct StreamPacket
+            {
+                int mFirstChannel = 0;              // First input channel in the packet
+                int mChannelCount = 0;              // Number of channels in the packet
+                int mFrameSize = 0;                 // Size of a frame of all channels in the packet in bytes
+                std::vector<nap::uint8> mBuffer;    // Header and payload
+                VBanHeader* getHeader() { return reinterpret_cast<VBanHeader*>(mBuffer.data()); }
+            };
+
+            void updatePacketLayout(int channelCount);
+            void flushPacket(int64_t dueTime);
+            bool suppressPacket(int64_t dueTime);
+            void sendSilenceDescriptor(int64_t dueTime);
+            int64_t getDueTime(int64_t blockTime, int frame, int& firstPacketFrame) const;
             int getChannelCount() const { return mChannelCount; }
-            void processBuffer(const SampleBuffer& buffer, int channel);
 
             // Inherited from Node
             void process() override;
             void sampleRateChanged(float) override;
 
             std::vector<std::vector<audio::SampleValue>*> mInputPullResult;
+            std::vector<const float*> mChannelData; // Sample data of every input channel handed to the encoder
             int mChannelCount = 0;
-            int mPacketChannelSize = 0;
-            int mPacketWritePosition = 0;
-            std::vector<nap::uint8> mPacketBuffer;
-            VBanHeader* mPacketHeader = nullptr;
+            int mSamplesPerFrame = VBAN_SAMPLES_MAX_NB;
+            bool mAlignToBufferSize = false;
+            int mMaxChannelsPerStream = 254;
+            int mLayoutBufferSize = 0;      // Audio buffer size the packet layout was aligned to
+            int mPacketFrames = 0;          // Number of frames in a full packet, 0 when nothing can be sent
+            int mPacketWritten = 0;         // Number of frames written into the current packets
+            std::vector<StreamPacket> mStreamPackets; // One packet per sibling stream, filled in parallel, allocated for one stream per channel
+            int mStreamCount = 0;           // Number of packets in use by the current layout
 
-            size_t mPacketSize = 0;
             uint32_t mFrameCounter = 0;
+            bool mPacing = false;
+            double mFrameDuration = 0.0;    // Duration of a sample frame in nanoseconds
+            int64_t mPacketStartTime = 0;   // Time the first frame of the current packets was encoded
+            bool mCompression = false;
+            std::vector<nap::uint8> mCompressedPacket; // Header and compressed payload of the packet being flushed
+
+            bool mSilenceSuppression = false;
+            float mSilenceThreshold = 0.0f;
+            float mSilenceHangover = 0.0f;  // Milliseconds
+            float mKeepAliveInterval = 0.0f; // Milliseconds
+            bool mPacketSilent = true;      // No sample of the current packets exceeded the threshold so far
+            bool mSuppressing = false;      // Silent packets are being replaced by silence descriptors
+            int64_t mSilentFrames = 0;      // Number of frames the stream has been silent
+            int64_t mKeepAliveFrames = 0;   // Number of frames suppressed since the last silence descriptor
+            std::array<nap::uint8, VBAN_SILENCE_DESCRIPTOR_SIZE> mSilenceDescriptor;
+            VBANCounter mSuppressedPackets; // Incremented on the audio thread
+            VBANLatencyMonitor* mLatencyMonitor = nullptr;
             uint8_t mSampleRateFormat = 0;
+            const VBANCodec* mCodec = nullptr;
             std::string mStreamName;
-            UDPClient* mUDPClient = nullptr;
+            std::shared_ptr<VBANPacketQueue> mPacketQueue = nullptr;
 		};
 
 	}
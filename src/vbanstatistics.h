@@ -0,0 +1,144 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Nap includes
+#include <utility/dllexport.h>
+
+// Std includes
+#include <array>
+#include <atomic>
+#include <stdint.h>
+
+namespace nap
+{
+    /**
+     * Event counter that is incremented on the network or audio thread and read from any thread.
+     * Lock free and never allocates.
+     */
+    class NAPAPI VBANCounter
+    {
+    public:
+        /**
+         * Increments the counter
+         * @param count the amount to add
+         */
+        void add(uint64_t count = 1) { mValue.fetch_add(count, std::memory_order_relaxed); }
+
+        /**
+         * @return the current value
+         */
+        uint64_t get() const { return mValue.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> mValue = { 0 };
+    };
+
+
+    /**
+     * Histogram with power of two bins, bin 0 counts the value 0 and bin n counts the values in [2^(n-1), 2^n).
+     * The last bin also counts all larger values. Recorded on the audio thread without locks or allocation,
+     * readable from any thread.
+     */
+    class NAPAPI VBANHistogram
+    {
+    public:
+        static constexpr int sBinCount = 16;
+        using Bins = std::array<uint64_t, sBinCount>;
+
+        /**
+         * Counts a value
+         * @param value the value to count
+         */
+        void record(uint32_t value)
+        {
+            int bin = 0;
+            while (value != 0 && bin < sBinCount - 1)
+            {
+                value >>= 1;
+                bin++;
+            }
+            mBins[bin].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /**
+         * Copies the current counts
+         * @param bins receives the count of every bin
+         */
+        void getBins(Bins& bins) const
+        {
+            for (int i = 0; i < sBinCount; i++)
+                bins[i] = mBins[i].load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @param bin the bin index
+         * @return the smallest value counted in the bin
+         */
+        static uint32_t getBinStart(int bin) { return bin == 0 ? 0 : 1u << (bin - 1); }
+
+    private:
+        std::array<std::atomic<uint64_t>, sBinCount> mBins = {};
+    };
+
+
+    /**
+     * Snapshot of the playout of a single VBAN stream, see VBANStreamPlayerComponentInstance::getStatistics()
+     */
+    struct NAPAPI VBANPlayoutStatistics
+    {
+        uint64_t mPacketsReleased = 0;      ///< Packets handed to the players in order
+        uint64_t mPacketsLost = 0;          ///< Packets that did not arrive within the reorder window
+        uint64_t mPacketsReordered = 0;     ///< Packets that arrived ahead of a missing packet and were held back
+        uint64_t mPacketsDuplicate = 0;     ///< Packets that were already held back
+        uint64_t mPacketsLate = 0;          ///< Packets that arrived after their position was played out
+        uint64_t mResyncs = 0;              ///< Number of times the sequence restarted, for example after a sender restart
+        uint64_t mUnderruns = 0;            ///< Audio blocks that could not be filled completely from the queue
+        uint64_t mDroppedSamples = 0;       ///< Samples per channel dropped because the queue reached MaxBufferSize
+        uint64_t mConcealedSamples = 0;     ///< Samples per channel of lost packets that were concealed
+        uint64_t mResampleRateChanges = 0;  ///< Number of times the player switched to converting the stream from another sample rate
+        VBANHistogram::Bins mQueueFill = {};///< Queued samples per channel, recorded once every audio block
+        int mSampleRate = 0;                ///< Sample rate of the queue, converts queued samples to latency
+        float mLatency = 0.0f;              ///< Current smoothed latency of the queue in milliseconds
+    };
+
+
+    /**
+     * Snapshot of the packets sent by a single VBAN sender, see VBANStreamSenderComponentInstance::getStatistics()
+     */
+    struct NAPAPI VBANSenderStatistics
+    {
+        uint64_t mPacketsQueued = 0;        ///< Packets produced on the audio thread and queued for sending
+        uint64_t mPacketsDropped = 0;       ///< Queued packets dropped because the network side fell behind
+        uint64_t mPacketsSent = 0;          ///< Packets handed to the network
+        uint64_t mPacketsSuppressed = 0;    ///< Silent packets not sent because of silence suppression, see VBANStreamSenderComponent::mSilenceSuppression
+    };
+
+
+    /**
+     * Latency distribution of the frames recorded by a VBANLatencyMonitor, see VBANLatencyMonitor::getReport()
+     */
+    struct NAPAPI VBANLatencyReport
+    {
+        /**
+         * Distribution of the latency of a single stage in milliseconds
+         */
+        struct Stage
+        {
+            float mMin = 0.0f;              ///< Lowest latency
+            float mMean = 0.0f;             ///< Average latency
+            float mMedian = 0.0f;           ///< 50th percentile
+            float mP95 = 0.0f;              ///< 95th percentile
+            float mMax = 0.0f;              ///< Highest latency
+        };
+
+        int mFrameCount = 0;                ///< Number of frames the distributions are computed from
+        Stage mPacketization;               ///< First sample encoded by the sender until its packet is queued for sending
+        Stage mNetwork;                     ///< Packet queued for sending until received by the socket, includes the send queue and pacing
+        Stage mQueueing;                    ///< Packet received until its first sample is read by the player, includes reordering and the playout queue
+        Stage mPlayout;                     ///< First sample read by the player until it leaves the audio device, estimated from the audio buffer
+        Stage mTotal;                       ///< First sample encoded by the sender until it leaves the audio device
+    };
+}
@@ -0,0 +1,126 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "vbanstreamassembler.h"
+
+// Std includes
+#include <algorithm>
+#include <cstring>
+
+namespace nap
+{
+    // A packet this many frames or more behind the frame in its slot belongs to a restarted sequence, not a late one
+    static constexpr int32_t sResyncDistance = 256;
+
+
+    void VBANStreamAssembler::init(const std::string& streamName, int streamCount, int channelCount, int slotCount, IVBANStreamListener& output)
+    {
+        mOutput = &output;
+        mChannelCount = channelCount;
+
+        mListeners.clear();
+        for (int stream = 0; stream < streamCount; stream++)
+            mListeners.emplace_back(std::make_unique<StreamListener>(*this, stream));
+        setStreamName(streamName);
+
+        mStreamChannels.assign(streamCount, 0);
+        mStreamOffsets.assign(streamCount, 0);
+        mLayoutKnown = false;
+
+        mSlots.resize(std::max(slotCount, 1));
+        for (auto& slot : mSlots)
+        {
+            slot.mReceived.assign(streamCount, false);
+            slot.mData.resize(static_cast<size_t>(channelCount) * VBAN_SAMPLES_MAX_NB);
+        }
+        reset();
+    }
+
+
+    void VBANStreamAssembler::setStreamName(const std::string& streamName)
+    {
+        for (size_t stream = 0; stream < mListeners.size(); stream++)
+            mListeners[stream]->mStreamName = streamName + "_" + std::to_string(stream);
+    }
+
+
+    void VBANStreamAssembler::push(int stream, const VBANBufferView& buffers)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        // the channel offsets change with the channel count of a stream, frames in progress are not valid anymore
+        if (mStreamChannels[stream] != buffers.mChannelCount)
+        {
+            mStreamChannels[stream] = buffers.mChannelCount;
+            mLayoutKnown = std::find(mStreamChannels.begin(), mStreamChannels.end(), 0) == mStreamChannels.end();
+            int offset = 0;
+            for (size_t i = 0; i < mStreamChannels.size(); i++)
+            {
+                mStreamOffsets[i] = offset;
+                offset += mStreamChannels[i];
+            }
+            reset();
+        }
+
+        // the position of the channels is unknown until every stream delivered a packet
+        if (!mLayoutKnown)
+            return;
+
+        // a late packet of a frame older than the one being assembled in its slot is dropped,
+        // a slot still holding an older, incomplete frame is taken over, that frame is lost
+        Slot& slot = mSlots[buffers.mFrameCounter % mSlots.size()];
+        if (slot.mUsed)
+        {
+            int32_t const age = static_cast<int32_t>(slot.mFrameCounter - buffers.mFrameCounter);
+            if (age > 0 && age < sResyncDistance)
+                return;
+        }
+        if (!slot.mUsed || slot.mFrameCounter != buffers.mFrameCounter)
+        {
+            std::fill(slot.mReceived.begin(), slot.mReceived.end(), false);
+            slot.mUsed = true;
+            slot.mFrameCounter = buffers.mFrameCounter;
+            slot.mFrameCount = buffers.mFrameCount;
+            slot.mSampleRate = buffers.mSampleRate;
+            slot.mSilence = buffers.mSilence;
+            slot.mReceivedCount = 0;
+            slot.mReceiveTime = 0;
+        }
+
+        // duplicate, or a packet that does not cover the same samples as its siblings
+        if (slot.mReceived[stream] || slot.mFrameCount != buffers.mFrameCount || slot.mSilence != buffers.mSilence)
+            return;
+
+        // copy the channels of the stream to their place in the frame
+        int const first_channel = mStreamOffsets[stream];
+        int const channel_count = std::min(buffers.mChannelCount, mChannelCount - first_channel);
+        if (channel_count > 0)
+            std::memcpy(&slot.mData[static_cast<size_t>(first_channel) * slot.mFrameCount], buffers.mData,
+                        static_cast<size_t>(channel_count) * slot.mFrameCount * sizeof(float));
+        slot.mReceived[stream] = true;
+        slot.mReceiveTime = std::max(slot.mReceiveTime, buffers.mReceiveTime);
+        if (++slot.mReceivedCount < getStreamCount())
+            return;
+
+        // all streams arrived
+        VBANBufferView view;
+        view.mData = slot.mData.data();
+        view.mChannelCount = std::min(mStreamOffsets.back() + mStreamChannels.back(), mChannelCount);
+        view.mFrameCount = slot.mFrameCount;
+        view.mFrameCounter = slot.mFrameCounter;
+        view.mSampleRate = slot.mSampleRate;
+        view.mReceiveTime = slot.mReceiveTime;
+        view.mSilence = slot.mSilence;
+
+        slot.mUsed = false;
+        mOutput->pushBuffers(view);
+    }
+
+
+    void VBANStreamAssembler::reset()
+    {
+        for (auto& slot : mSlots)
+            slot.mUsed = false;
+    }
+}
@@ -0,0 +1,109 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Vban includes
+#include "vbanpacketreceiver.h"
+
+// Std includes
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nap
+{
+    /**
+     * Assembles the sibling streams 'name_0', 'name_1' etc. a wide channel layout is split into by the VBANSenderNode.
+     * The packets of all sibling streams with the same frame counter are combined into a single view holding the channels
+     * of all streams in order, as soon as the last of them arrives. A frame that is still incomplete when its slot is
+     * needed for a newer frame is dropped, the jitter buffer behind the assembler reports it as lost.
+     * The assembler provides a listener per sibling stream to register with the VBANPacketReceiver.
+     * Sibling streams may arrive on different network threads, a mutex serializes them so the output is called from one thread at a time.
+     * All storage is allocated on init.
+     */
+    class NAPAPI VBANStreamAssembler
+    {
+    public:
+        /**
+         * Creates the listeners of the sibling streams and allocates storage, not thread safe
+         * @param streamName name of the stream, the index of every sibling stream is appended
+         * @param streamCount number of sibling streams
+         * @param channelCount max number of channels of all streams together to assemble, further channels are ignored
+         * @param slotCount number of frames that can be assembled at the same time
+         * @param output receives the assembled frames, its sample rate is reported by the listeners
+         */
+        void init(const std::string& streamName, int streamCount, int channelCount, int slotCount, IVBANStreamListener& output);
+
+        /**
+         * Renames the sibling streams, call when the listeners are not registered
+         * @param streamName name of the stream, the index of every sibling stream is appended
+         */
+        void setStreamName(const std::string& streamName);
+
+        /**
+         * @return number of sibling streams
+         */
+        int getStreamCount() const { return static_cast<int>(mListeners.size()); }
+
+        /**
+         * Returns the listener that receives a sibling stream, register it with the VBANPacketReceiver
+         * @param stream index of the sibling stream
+         * @return the listener of the stream
+         */
+        IVBANStreamListener& getListener(int stream) { assert(stream < getStreamCount()); return *mListeners[stream]; }
+
+        /**
+         * Adds the packet of a sibling stream, hands the frame to the output once the packets of all streams arrived
+         * @param stream index of the sibling stream
+         * @param buffers the packet
+         */
+        void push(int stream, const VBANBufferView& buffers);
+
+    private:
+        /**
+         * Receives a single sibling stream and forwards its packets to the assembler
+         */
+        class StreamListener : public IVBANStreamListener
+        {
+        public:
+            StreamListener(VBANStreamAssembler& assembler, int stream) : mAssembler(assembler), mStream(stream) { }
+
+            void pushBuffers(const VBANBufferView& buffers) override { mAssembler.push(mStream, buffers); }
+            const std::string& getStreamName() override { return mStreamName; }
+            int getSampleRate() const override { return mAssembler.mOutput->getSampleRate(); }
+
+            std::string mStreamName;
+
+        private:
+            VBANStreamAssembler& mAssembler;
+            int mStream = 0;
+        };
+
+        struct Slot
+        {
+            bool mUsed = false;
+            uint32_t mFrameCounter = 0;
+            int mFrameCount = 0;
+            int mSampleRate = 0;
+            int mReceivedCount = 0;
+            int64_t mReceiveTime = 0;       // Receive time of the last stream that arrived
+            bool mSilence = false;          // The frame is a silence descriptor, sent by all streams
+            std::vector<bool> mReceived;    // Streams that arrived for this frame
+            std::vector<float> mData;       // Assembled channels, stored contiguously, same as the view
+        };
+
+        void reset();
+
+        std::vector<std::unique_ptr<StreamListener>> mListeners;
+        std::vector<Slot> mSlots;
+        std::vector<int> mStreamChannels;   // Channel count of every stream, learned from its packets, 0 when unknown
+        std::vector<int> mStreamOffsets;    // First assembled channel of every stream
+        bool mLayoutKnown = false;          // All streams delivered a packet, so the offsets are valid
+        int mChannelCount = 0;
+        IVBANStreamListener* mOutput = nullptr;
+        std::mutex mMutex;
+    };
+}
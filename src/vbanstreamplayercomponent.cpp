@@ -12,12 +12,35 @@
 // Audio includes
 #include <audio/service/audioservice.h>
 
+// Std includes
+#include <algorithm>
+
 // RTTI
+RTTI_BEGIN_ENUM(nap::audio::EResampleQuality)
+	RTTI_ENUM_VALUE(nap::audio::EResampleQuality::Low,		"Low"),
+	RTTI_ENUM_VALUE(nap::audio::EResampleQuality::Medium,	"Medium"),
+	RTTI_ENUM_VALUE(nap::audio::EResampleQuality::High,		"High")
+RTTI_END_ENUM
+
+RTTI_BEGIN_ENUM(nap::audio::ELatencyUnit)
+	RTTI_ENUM_VALUE(nap::audio::ELatencyUnit::Samples,		"Samples"),
+	RTTI_ENUM_VALUE(nap::audio::ELatencyUnit::Milliseconds,	"Milliseconds")
+RTTI_END_ENUM
+
 RTTI_BEGIN_CLASS(nap::audio::VBANStreamPlayerComponent)
 		RTTI_PROPERTY("VBANPacketReceiver", &nap::audio::VBANStreamPlayerComponent::mVBANPacketReceiver, nap::rtti::EPropertyMetaData::Required)
 		RTTI_PROPERTY("ChannelRouting", &nap::audio::VBANStreamPlayerComponent::mChannelRouting, nap::rtti::EPropertyMetaData::Default)
 		RTTI_PROPERTY("MaxBufferSize", &nap::audio::VBANStreamPlayerComponent::mMaxBufferSize, nap::rtti::EPropertyMetaData::Default)
 		RTTI_PROPERTY("StreamName", &nap::audio::VBANStreamPlayerComponent::mStreamName, nap::rtti::EPropertyMetaData::Default)
+		RTTI_PROPERTY("StreamCount", &nap::audio::VBANStreamPlayerComponent::mStreamCount, nap::rtti::EPropertyMetaData::Default)
+		RTTI_PROPERTY("ReorderWindow", &nap::audio::VBANStreamPlayerComponent::mReorderWindow, nap::rtti::EPropertyMetaData::Default)
+		RTTI_PROPERTY("Concealment", &nap::audio::VBANStreamPlayerComponent::mConcealment, nap::rtti::EPropertyMetaData::Default)
+		RTTI_PROPERTY("DriftCompensation", &nap::audio::VBANStreamPlayerComponent::mDriftCompensation, nap::rtti::EPropertyMetaData::Default)
+		RTTI_PROPERTY("LatencyControl", &nap::audio::VBANStreamPlayerComponent::mLatencyControl, nap::rtti::EPropertyMetaData::Default)
+		RTTI_PROPERTY("TargetLatency", &nap::audio::VBANStreamPlayerComponent::mTargetLatency, nap::rtti::EPropertyMetaData::Default)
+		RTTI_PROPERTY("LatencyUnit", &nap::audio::VBANStreamPlayerComponent::mLatencyUnit, nap::rtti::EPropertyMetaData::Default)
+		RTTI_PROPERTY("ResampleQuality", &nap::audio::VBANStreamPlayerComponent::mResampleQuality, nap::rtti::EPropertyMetaData::Default)
+		RTTI_PROPERTY("LatencyMonitor", &nap::audio::VBANStreamPlayerComponent::mLatencyMonitor, nap::rtti::EPropertyMetaData::Default)
 RTTI_END_CLASS
 
 RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::audio::VBANStreamPlayerComponentInstance)
@@ -31,7 +54,7 @@ namespace nap
 	{
 		void VBANStreamPlayerComponentInstance::onDestroy()
 		{
-            mVbanListener->removeStreamListener(this);
+            removeListeners();
 		}
 
 
@@ -46,37 +69,184 @@ namespace nap
 			mStreamName = mResource->mStreamName;
 			mNodeManager = &mAudioService->getNodeManager();
 			mChannelRouting = mResource->mChannelRouting;
+            mResampleQuality = mResource->mResampleQuality;
 
             // get sample rate
             mSampleRate = static_cast<int>(mNodeManager->getSampleRate());
 
-            // create buffer player for each channel
-			for (auto channel = 0; channel < mChannelRouting.size(); ++channel)
-			{
-				auto bufferPlayer = mNodeManager->makeSafe<SampleQueuePlayerNode>(*mNodeManager);
-                bufferPlayer->mMaxQueueSize = mResource->mMaxBufferSize;
-				mBufferPlayers.emplace_back(std::move(bufferPlayer));
-			}
+            // both drift compensation and latency control converge to the target latency
+            float const target_latency = mResource->mLatencyUnit == ELatencyUnit::Milliseconds ?
+                mResource->mTargetLatency * 0.001f * mNodeManager->getSampleRate() : mResource->mTargetLatency;
+            // both hold the queue at the target latency in their own way, the player runs one of them
+            if (!errorState.check(!(mResource->mDriftCompensation && mResource->mLatencyControl),
+                                  "%s: DriftCompensation and LatencyControl can't be combined, enable one of them", mResource->mID.c_str()))
+                return false;
+            if (mResource->mDriftCompensation || mResource->mLatencyControl)
+            {
+                if (!errorState.check(target_latency >= 1.0f && target_latency < mResource->mMaxBufferSize,
+                                      "%s: TargetLatency must be at least 1 sample and smaller than MaxBufferSize", mResource->mID.c_str()))
+                    return false;
+            }
+
+            if (mResource->mDriftCompensation)
+                mDriftController = std::make_shared<ClockDriftController>(target_latency, mNodeManager->getSampleRate(), mNodeManager->getInternalBufferSize());
+
+            // create a single player for all channels, keeps the channels aligned
+            mPlayer = mNodeManager->makeSafe<SampleQueuePlayerNode>(*mNodeManager, static_cast<int>(mChannelRouting.size()), mResource->mMaxBufferSize);
+            mPlayer->setConcealment(mResource->mConcealment);
+            if (mDriftController != nullptr)
+                mPlayer->setDriftController(mDriftController);
+            if (mResource->mLatencyControl)
+                mPlayer->setTargetLatency(static_cast<int>(target_latency + 0.5f));
+            mLatencyMonitor = mResource->mLatencyMonitor.get();
+            if (mLatencyMonitor != nullptr)
+                mPlayer->setLatencyMonitor(mLatencyMonitor);
+
+            // allocate the reorder window
+            if (!errorState.check(mResource->mReorderWindow > 0, "%s: ReorderWindow must be 1 or larger", mResource->mID.c_str()))
+                return false;
+            mJitterBuffer.init(mResource->mReorderWindow, mChannelRouting.size());
+
+            // a split stream is received as sibling streams, the assembler combines them into frames for the jitter buffer
+            if (!errorState.check(mResource->mStreamCount > 0, "%s: StreamCount must be 1 or larger", mResource->mID.c_str()))
+                return false;
+            mAssembled = mResource->mStreamCount > 1;
+            if (mAssembled)
+                mAssembler.init(mStreamName, mResource->mStreamCount, mChannelRouting.size(), std::max(mResource->mReorderWindow, 4), *this);
+
+            // build a resampler for every VBAN sample rate up front, so a stream changing rate doesn't allocate on the network thread
+            mResamplers.resize(VBAN_SR_MAXNUMBER);
+            mResampleStride = 0;
+            for (int format = 0; format < VBAN_SR_MAXNUMBER; format++)
+            {
+                int const rate = static_cast<int>(VBanSRList[format]);
+                if (rate == mSampleRate)
+                    continue;
+                mResamplers[format].init(rate, mSampleRate, getChannelCount(), VBAN_SAMPLES_MAX_NB, mResampleQuality);
+                mResampleStride = std::max(mResampleStride, mResamplers[format].getMaxOutputFrames());
+            }
+            mResampleBuffer.assign(static_cast<size_t>(getChannelCount()) * mResampleStride, 0.0f);
+            mResampler = nullptr;
 
             // register to the packet receiver
-            mVbanListener->registerStreamListener(this);
+            registerListeners();
 
 			return true;
 		}
 
 
-		void VBANStreamPlayerComponentInstance::pushBuffers(const std::vector<std::vector<float>>& buffers)
+		void VBANStreamPlayerComponentInstance::setStreamName(const std::string& streamName)
 		{
-			if(buffers.size() >= getChannelCount())
+            // the packet receiver indexes listeners by stream name, so register again under the new name
+            if (mVbanListener != nullptr)
+            {
+                removeListeners();
+                mStreamName = streamName;
+                mAssembler.setStreamName(streamName);
+                registerListeners();
+            }
+            else
+            {
+                mStreamName = streamName;
+                mAssembler.setStreamName(streamName);
+            }
+		}
+
+
+		void VBANStreamPlayerComponentInstance::registerListeners()
+		{
+            if (!mAssembled)
+            {
+                mVbanListener->registerStreamListener(this);
+                return;
+            }
+            for (int stream = 0; stream < mAssembler.getStreamCount(); stream++)
+                mVbanListener->registerStreamListener(&mAssembler.getListener(stream));
+		}
+
+
+		void VBANStreamPlayerComponentInstance::removeListeners()
+		{
+            if (!mAssembled)
+            {
+                mVbanListener->removeStreamListener(this);
+                return;
+            }
+            for (int stream = 0; stream < mAssembler.getStreamCount(); stream++)
+                mVbanListener->removeStreamListener(&mAssembler.getListener(stream));
+		}
+
+
+		void VBANStreamPlayerComponentInstance::pushBuffers(const VBANBufferView& buffers)
+		{
+			if(buffers.mChannelCount >= getChannelCount())
 			{
-				for(int i = 0; i < mBufferPlayers.size(); i++)
-				{
-					mBufferPlayers[i]->queueSamples(&buffers[i][0], buffers[i].size());
-				}
+                mJitterBuffer.push(buffers, *this);
 			}else
 			{
-				nap::Logger::warn("error received %i buffers but expected %i", buffers.size(), getChannelCount());
+				nap::Logger::warn("error received %i buffers but expected %i", buffers.mChannelCount, getChannelCount());
 			}
 		}
+
+
+		void VBANStreamPlayerComponentInstance::framesReleased(const VBANBufferView& buffers)
+		{
+            mStreamSampleRate = buffers.mSampleRate;
+
+            // the sender suppresses silence, the player plays silence until audio arrives again
+            if (buffers.mSilence)
+            {
+                mPlayer->suspend();
+                return;
+            }
+
+            if (mLatencyMonitor != nullptr)
+                mLatencyMonitor->packetQueued(buffers.mFrameCounter, buffers.mReceiveTime, mPlayer->getWritePosition());
+
+            if (mStreamSampleRate == mSampleRate)
+            {
+                mResampler = nullptr;
+                mPlayer->queueSamples(buffers.mData, buffers.mFrameCount, buffers.mFrameCount);
+                return;
+            }
+
+            // stream runs at a different rate than the audio engine, switch to the resampler of the rate when the stream rate changes
+            if (mResampler == nullptr || mResampler->getInputRate() != mStreamSampleRate)
+            {
+                auto found = std::find(VBanSRList, VBanSRList + VBAN_SR_MAXNUMBER, mStreamSampleRate);
+                if (found == VBanSRList + VBAN_SR_MAXNUMBER)
+                    return;
+                mResampler = &mResamplers[found - VBanSRList];
+                mResampler->reset();
+                mResampleRateChanges.add();
+            }
+
+            int const frames = mResampler->process(buffers.mData, buffers.mFrameCount, mResampleBuffer.data(), mResampleStride);
+            mPlayer->queueSamples(mResampleBuffer.data(), mResampleStride, frames);
+		}
+
+
+		void VBANStreamPlayerComponentInstance::gapDetected(int frameCount)
+		{
+            // the gap has the length of the missing samples after conversion to the engine rate
+            if (mStreamSampleRate != mSampleRate && mResampler != nullptr && mResampler->getInputRate() == mStreamSampleRate)
+                frameCount = mResampler->toOutputFrames(frameCount);
+
+            mPlayer->queueGap(frameCount);
+		}
+	
+
+		void VBANStreamPlayerComponentInstance::getStatistics(VBANPlayoutStatistics& statistics) const
+		{
+            mJitterBuffer.getStatistics(statistics);
+
+            statistics.mUnderruns = mPlayer->getUnderrunCount();
+            statistics.mDroppedSamples = mPlayer->getDroppedSampleCount();
+            statistics.mConcealedSamples = mPlayer->getConcealedSampleCount();
+            statistics.mResampleRateChanges = mResampleRateChanges.get();
+            mPlayer->getQueueFillHistogram().getBins(statistics.mQueueFill);
+            statistics.mSampleRate = mSampleRate;
+            statistics.mLatency = getEffectiveLatency();
+		}
 	}
 }
@@ -19,6 +19,10 @@
 // Vban includes
 #include "samplequeueplayernode.h"
 #include "vbanpacketreceiver.h"
+#include "vbanjitterbuffer.h"
+#include "vbanlatencymonitor.h"
+#include "vbanstreamassembler.h"
+#include "polyphaseresampler.h"
 
 namespace nap
 {
@@ -28,6 +32,15 @@ namespace nap
 		class AudioService;
 		class VBANStreamPlayerComponentInstance;
 
+        /**
+         * Unit of the target latency of the VBANStreamPlayerComponent
+         */
+        enum class ELatencyUnit : int
+        {
+            Samples         = 0,    ///< Samples at the sample rate of the audio engine
+            Milliseconds    = 1     ///< Milliseconds
+        };
+
         /**
          * VBANStreamPlayerComponent hooks up to a VBANPacketReceiver and translates incoming VBAN packets
          * to audio buffers handled by a bufferplayer for each channel.
@@ -54,6 +67,15 @@ namespace nap
 			std::vector<int> mChannelRouting = { }; ///< Property: "ChannelRouting" the channel routing, must be equal to excpected channels from stream
 			int mMaxBufferSize = 4096; ///< Property: "MaxBufferSize" the max buffer size in samples. Keep this as low as possible to ensure the lowest possible latency
 			std::string mStreamName = "localhost"; ///< Property: "StreamName" the VBAN stream to listen to
+			int mStreamCount = 1; ///< Property: "StreamCount" number of sibling streams 'StreamName_0', 'StreamName_1' etc. a wide channel layout is split into by the sender, assembled sample aligned
+			int mReorderWindow = 4; ///< Property: "ReorderWindow" number of packets a missing packet is waited for before it is considered lost, 1 disables reordering
+			bool mConcealment = true; ///< Property: "Concealment" fill lost packets with a repetition of the preceding audio instead of silence
+			bool mDriftCompensation = false; ///< Property: "DriftCompensation" resample the stream to compensate for clock drift between sender and receiver
+			bool mLatencyControl = false; ///< Property: "LatencyControl" prefill to the target latency and converge to it by skipping or repeating crossfaded segments, can't be combined with DriftCompensation
+			float mTargetLatency = 1024.0f; ///< Property: "TargetLatency" the latency drift compensation and latency control converge to, must be smaller than MaxBufferSize
+			ELatencyUnit mLatencyUnit = ELatencyUnit::Samples; ///< Property: "LatencyUnit" unit of the target latency
+			EResampleQuality mResampleQuality = EResampleQuality::Medium; ///< Property: "ResampleQuality" quality of the conversion of streams with a different sample rate than the audio engine
+			ResourcePtr<VBANLatencyMonitor> mLatencyMonitor = nullptr; ///< Property: "LatencyMonitor" optional monitor that measures the latency of the stream, share it with the VBANStreamSenderComponent sending the stream
 		public:
 		};
 
@@ -62,7 +84,7 @@ namespace nap
          * VBANStreamPlayerComponentInstance
          * Instance of VBANStreamPlayerComponent. Implements IVBANStreamListener interface
          */
-		class NAPAPI VBANStreamPlayerComponentInstance : public AudioComponentBaseInstance, public IVBANStreamListener
+		class NAPAPI VBANStreamPlayerComponentInstance : public AudioComponentBaseInstance, public IVBANStreamListener, public VBANJitterBuffer::IOutput
 		{
 			RTTI_ENABLE(AudioComponentBaseInstance)
 
@@ -92,26 +114,26 @@ namespace nap
 			 * Returns amount of channels
 			 * @return amount of channels
 			 */
-			int getChannelCount() const override { return mBufferPlayers.size(); }
+			int getChannelCount() const override { return mChannelRouting.size(); }
 
             /**
              * Returns output pin for given channel, no bound checking, assert on out of bound
              * @param channel the channel
              * @return OutputPin for channel
              */
-			OutputPin* getOutputForChannel(int channel) override { assert(channel < mBufferPlayers.size()); return &mBufferPlayers[channel]->audioOutput; }
+			OutputPin* getOutputForChannel(int channel) override { assert(channel < getChannelCount()); return &mPlayer->getOutput(channel); }
 
             /**
-             * Pushes the buffers to the buffer players
-             * @param buffers the buffers to push
+             * Pushes the buffers through the jitter buffer to the player
+             * @param buffers view on the buffers to push
              */
-			void pushBuffers(const std::vector<std::vector<float>>& buffers) override;
+			void pushBuffers(const VBANBufferView& buffers) override;
 
             /**
-             * Sets streamname this VBANStreamPlayer accepts
+             * Sets streamname this VBANStreamPlayer accepts, re-registers the player with the packet receiver
              * @param streamName this VBANStreamPlayer accepts
              */
-            void setStreamName(const std::string& streamName){ mStreamName = streamName; }
+            void setStreamName(const std::string& streamName);
 
             /**
              * Returns streamname this VBANStreamPlayer accepts
@@ -125,8 +147,49 @@ namespace nap
              */
             int getSampleRate() const override{ return mSampleRate; }
 
+            /**
+             * Returns the resampling ratio used to compensate clock drift, 1.0 when drift compensation is disabled
+             * @return number of received samples played per output sample
+             */
+            double getDriftRatio() const { return mDriftController != nullptr ? mDriftController->getRatio() : 1.0; }
+
+            /**
+             * Returns the current latency of the playout queue, smoothed over the last audio blocks
+             * @return the amount of queued audio in milliseconds
+             */
+            float getEffectiveLatency() const { return 1000.0f * mPlayer->getLatency() / static_cast<float>(mSampleRate); }
+
+            /**
+             * Copies the packet, underrun and queue fill counters of the stream, call from the main thread.
+             * Counters are collected on the network and audio thread without locks, the snapshot is not atomic as a whole.
+             * @param statistics receives the counters
+             */
+            void getStatistics(VBANPlayoutStatistics& statistics) const;
+
 		private:
-			std::vector<SafeOwner<SampleQueuePlayerNode>> mBufferPlayers;
+            // Inherited from VBANJitterBuffer::IOutput, queues packets that are released in order
+            void framesReleased(const VBANBufferView& buffers) override;
+            void gapDetected(int frameCount) override;
+
+            // Registers the player, or the listeners of the sibling streams, with the packet receiver
+            void registerListeners();
+            void removeListeners();
+
+			SafeOwner<SampleQueuePlayerNode> mPlayer = nullptr; // Plays all channels of the stream
+            VBANJitterBuffer mJitterBuffer; // Restores packet order, only accessed from the network thread
+            VBANStreamAssembler mAssembler; // Assembles the sibling streams when the stream is split
+            bool mAssembled = false; // Receives sibling streams through the assembler instead of a single stream
+            std::shared_ptr<ClockDriftController> mDriftController = nullptr;
+
+            // Sample rate conversion, built on init and only accessed from the network thread afterwards
+            std::vector<PolyphaseResampler> mResamplers; // One per VBAN sample rate format, the engine rate is not converted
+            PolyphaseResampler* mResampler = nullptr; // Resampler of the current stream rate
+            std::vector<float> mResampleBuffer;
+            int mResampleStride = 0; // Largest output of all resamplers, distance between the channels in mResampleBuffer
+            VBANCounter mResampleRateChanges; // Number of times the resampler of another stream rate was selected
+            EResampleQuality mResampleQuality = EResampleQuality::Medium;
+            int mStreamSampleRate = 0; // sample rate of the last received packet
+            VBANLatencyMonitor* mLatencyMonitor = nullptr; // optional, stamps the frames queued for playout
 			std::vector<int> mChannelRouting;
 			std::string mStreamName;
 
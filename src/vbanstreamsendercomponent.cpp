@@ -6,16 +6,45 @@
 #include "udppacket.h"
 #include "vbansendernode.h"
 #include "vbanutils.h"
+#include "vbancodec.h"
+#include "vbanlosslesscodec.h"
 #include "vban/vban.h"
 
 #include <entity.h>
 #include <audio/service/audioservice.h>
 #include <audio/node/outputnode.h>
 
+// Std includes
+#include <algorithm>
+
+RTTI_BEGIN_ENUM(nap::EVBANBitResolution)
+	RTTI_ENUM_VALUE(nap::EVBANBitResolution::Int8,		"Int8"),
+	RTTI_ENUM_VALUE(nap::EVBANBitResolution::Int16,		"Int16"),
+	RTTI_ENUM_VALUE(nap::EVBANBitResolution::Int24,		"Int24"),
+	RTTI_ENUM_VALUE(nap::EVBANBitResolution::Int32,		"Int32"),
+	RTTI_ENUM_VALUE(nap::EVBANBitResolution::Float32,	"Float32"),
+	RTTI_ENUM_VALUE(nap::EVBANBitResolution::Float64,	"Float64")
+RTTI_END_ENUM
+
 RTTI_BEGIN_CLASS(nap::audio::VBANStreamSenderComponent)
-RTTI_PROPERTY("UdpClient", &nap::audio::VBANStreamSenderComponent::mUdpClient, nap::rtti::EPropertyMetaData::Required)
+RTTI_PROPERTY("Transmitter", &nap::audio::VBANStreamSenderComponent::mTransmitter, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("Endpoints", &nap::audio::VBANStreamSenderComponent::mEndpoints, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("Port", &nap::audio::VBANStreamSenderComponent::mPort, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("Broadcast", &nap::audio::VBANStreamSenderComponent::mBroadcast, nap::rtti::EPropertyMetaData::Default)
 RTTI_PROPERTY("Input", &nap::audio::VBANStreamSenderComponent::mInput, nap::rtti::EPropertyMetaData::Required)
 RTTI_PROPERTY("StreamName", &nap::audio::VBANStreamSenderComponent::mStreamName, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("BitResolution", &nap::audio::VBANStreamSenderComponent::mBitResolution, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("SamplesPerFrame", &nap::audio::VBANStreamSenderComponent::mSamplesPerFrame, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("AlignToBufferSize", &nap::audio::VBANStreamSenderComponent::mAlignToBufferSize, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("Pacing", &nap::audio::VBANStreamSenderComponent::mPacing, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("MaxChannelsPerStream", &nap::audio::VBANStreamSenderComponent::mMaxChannelsPerStream, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("SendQueueSize", &nap::audio::VBANStreamSenderComponent::mSendQueueSize, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("Compression", &nap::audio::VBANStreamSenderComponent::mCompression, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("SilenceSuppression", &nap::audio::VBANStreamSenderComponent::mSilenceSuppression, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("SilenceThreshold", &nap::audio::VBANStreamSenderComponent::mSilenceThreshold, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("SilenceHangover", &nap::audio::VBANStreamSenderComponent::mSilenceHangover, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("KeepAliveInterval", &nap::audio::VBANStreamSenderComponent::mKeepAliveInterval, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("LatencyMonitor", &nap::audio::VBANStreamSenderComponent::mLatencyMonitor, nap::rtti::EPropertyMetaData::Default)
 RTTI_END_CLASS
 
 RTTI_BEGIN_CLASS_NO_DEFAULT_CONSTRUCTOR(nap::audio::VBANStreamSenderComponentInstance)
@@ -29,7 +58,12 @@ namespace nap
 
 	void VBANStreamSenderComponentInstance::onDestroy()
 	{
-        mVBANSenderNode->setUDPClient(nullptr);
+        if (mVBANSenderNode.get() != nullptr)
+            mVBANSenderNode->setPacketQueue(nullptr);
+        if (mSender != nullptr)
+            mSender->stop();
+        if (mTransmitter != nullptr && mQueue != nullptr)
+            mTransmitter->removeSender(mQueue.get());
 	}
 
 
@@ -58,10 +92,69 @@ namespace nap
             }
         }
 
+        // Wide inputs are split into sibling streams, the index appended to their name has to fit the header
+        if (!errorState.check(resource->mMaxChannelsPerStream >= 1 && resource->mMaxChannelsPerStream <= 254,
+                              "%s: MaxChannelsPerStream must be between 1 and 254", resource->mID.c_str()))
+            return false;
+        int const channel_count = static_cast<int>(std::count_if(channelRouting.begin(), channelRouting.end(), [](int channel) { return channel >= 0; }));
+        int const stream_count = VBANSenderNode::getStreamCount(channel_count, resource->mMaxChannelsPerStream);
+        if (stream_count > 1)
+        {
+            std::string const last_name = resource->mStreamName + "_" + std::to_string(stream_count - 1);
+            if (!errorState.check(last_name.size() <= VBAN_STREAM_NAME_SIZE, "%s: StreamName is too long to append the index of %i sibling streams",
+                                  resource->mID.c_str(), stream_count))
+                return false;
+        }
+
+        // At least a single frame of the widest stream has to fit in a packet
+        int const stream_channels = VBANSenderNode::getStreamChannelCount(channel_count, resource->mMaxChannelsPerStream);
+        int const sample_size = utility::getVBANCodec(static_cast<VBanBitResolution>(resource->mBitResolution))->mSampleSize;
+        if (!errorState.check(stream_channels * sample_size <= VBAN_DATA_MAX_SIZE, "%s: %i channels of %i bytes do not fit in a VBAN packet, lower MaxChannelsPerStream",
+                              resource->mID.c_str(), stream_channels, sample_size))
+            return false;
+
+        if (!errorState.check(resource->mSamplesPerFrame >= 1 && resource->mSamplesPerFrame <= VBAN_SAMPLES_MAX_NB,
+                              "%s: SamplesPerFrame must be between 1 and %i", resource->mID.c_str(), VBAN_SAMPLES_MAX_NB))
+            return false;
+        if (!errorState.check(resource->mSendQueueSize > 0, "%s: SendQueueSize must be 1 or larger", resource->mID.c_str()))
+            return false;
+        if (!errorState.check(!resource->mCompression || utility::isLosslessSupported(static_cast<VBanBitResolution>(resource->mBitResolution)),
+                              "%s: Compression requires an 8, 16 or 24 bit integer BitResolution", resource->mID.c_str()))
+            return false;
+        if (!errorState.check(resource->mSilenceThreshold >= 0.0f && resource->mSilenceHangover >= 0.0f,
+                              "%s: SilenceThreshold and SilenceHangover can't be negative", resource->mID.c_str()))
+            return false;
+        if (!errorState.check(resource->mKeepAliveInterval > 0.0f, "%s: KeepAliveInterval must be larger than 0", resource->mID.c_str()))
+            return false;
+
+        // Send through the shared transmitter or a thread of our own
+        if (resource->mTransmitter != nullptr)
+        {
+            mTransmitter = resource->mTransmitter.get();
+            mQueue = mTransmitter->addSender(resource->mEndpoints, resource->mPort, resource->mSendQueueSize, errorState);
+            if (mQueue == nullptr)
+                return false;
+        }
+        else
+        {
+            mSender = std::make_unique<VBANPacketSender>(resource->mSendQueueSize, VBAN_PROTOCOL_MAX_SIZE);
+            if (!mSender->start(resource->mID, resource->mEndpoints, resource->mPort, resource->mBroadcast, errorState))
+                return false;
+            mQueue = mSender->getQueue();
+        }
+
         // Create the VBAN sender node
-        mVBANSenderNode = nodeManager.makeSafe<VBANSenderNode>(nodeManager);
+        mVBANSenderNode = nodeManager.makeSafe<VBANSenderNode>(nodeManager, channel_count);
         mVBANSenderNode->setStreamName(resource->mStreamName);
-        mVBANSenderNode->setUDPClient(resource->mUdpClient.get());
+        mVBANSenderNode->setBitResolution(resource->mBitResolution);
+        mVBANSenderNode->setSamplesPerFrame(resource->mSamplesPerFrame, resource->mAlignToBufferSize);
+        mVBANSenderNode->setMaxChannelsPerStream(resource->mMaxChannelsPerStream);
+        mVBANSenderNode->setPacing(resource->mPacing);
+        mVBANSenderNode->setLatencyMonitor(resource->mLatencyMonitor.get());
+        mVBANSenderNode->setCompression(resource->mCompression);
+        mVBANSenderNode->setSilenceSuppression(resource->mSilenceSuppression, resource->mSilenceThreshold,
+                                               resource->mSilenceHangover, resource->mKeepAliveInterval);
+        mVBANSenderNode->setPacketQueue(mQueue);
 
         // Connect outputs to VBAN sender node
 		for (auto channel = 0; channel < channelRouting.size(); ++channel)
@@ -76,4 +169,11 @@ namespace nap
 	}
 
 
+	void VBANStreamSenderComponentInstance::getStatistics(VBANSenderStatistics& statistics) const
+	{
+        statistics.mPacketsQueued = mQueue->getQueuedCount();
+        statistics.mPacketsDropped = mQueue->getDroppedCount();
+        statistics.mPacketsSent = mQueue->getSentCount();
+        statistics.mPacketsSuppressed = mVBANSenderNode->getSuppressedPacketCount();
+	}
 }
\ No newline at end of file
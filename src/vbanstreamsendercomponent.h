@@ -4,13 +4,15 @@
 
 #pragma once
 
-#include "udpclient.h"
 #include "vbansendernode.h"
+#include "vbanlatencymonitor.h"
+#include "vbanpacketsender.h"
+#include "vbanstatistics.h"
+#include "vbanudptransmitter.h"
 
 // Nap includes
 #include <nap/resourceptr.h>
 #include <audio/utility/safeptr.h>
-#include <udpclient.h>
 
 // Audio includes
 #include <audio/component/audiocomponentbase.h>
@@ -35,10 +37,25 @@ namespace nap
 			DECLARE_COMPONENT(VBANStreamSenderComponent, VBANStreamSenderComponentInstance)
 		public:
 			// Properties
-			ResourcePtr<UDPClient> mUdpClient = nullptr; ///< property: 'UDPClient' The udpclient that sends the VBAN packets
+			ResourcePtr<VBANUDPTransmitter> mTransmitter = nullptr; ///< property: 'Transmitter' Optional shared batched transmit backend, the component sends from a thread and socket of its own when not set
+			std::vector<std::string> mEndpoints = { "127.0.0.1" }; ///< property: 'Endpoints' IPv4 unicast, multicast or broadcast addresses the packets are sent to, as 'address' or 'address:port'. Every packet is encoded once for all endpoints
+			int mPort = 13251; ///< property: 'Port' Port of the endpoints that don't specify one
+			bool mBroadcast = false; ///< property: 'Broadcast' Allow sending to broadcast addresses, only used without a 'Transmitter'
 			std::string mStreamName			  = "localhost"; ///< property: 'StreamName' The streamname of the VBAN stream
 			nap::ComponentPtr<audio::AudioComponentBase> mInput; ///< property: 'Input' The component whose audio output will be send
 			std::vector<int> mChannelRouting; ///< property: 'ChannelRouting' The component whose audio output will be send
+			EVBANBitResolution mBitResolution = EVBANBitResolution::Int16; ///< property: 'BitResolution' The PCM sample format of the VBAN stream
+			int mSamplesPerFrame = VBAN_SAMPLES_MAX_NB; ///< property: 'SamplesPerFrame' Max number of samples per channel in a packet, lower values reduce the packetization latency
+			bool mAlignToBufferSize = false; ///< property: 'AlignToBufferSize' Split every audio buffer evenly over packets and send them in the same callback, no samples wait for the next buffer
+			bool mPacing = false; ///< property: 'Pacing' Spread the packets of an audio buffer evenly over the audio period instead of sending them back to back
+			int mMaxChannelsPerStream = 254; ///< property: 'MaxChannelsPerStream' Wider inputs are split into sibling streams 'name_0', 'name_1' etc. with frame aligned counters
+			int mSendQueueSize = 64; ///< property: 'SendQueueSize' Max number of packets waiting to be sent, the oldest packets are dropped when the network falls behind
+			bool mCompression = false; ///< property: 'Compression' Losslessly compress packets of 8, 16 or 24 bit integer streams, sent as VBAN_CODEC_USER packets when smaller than PCM
+			bool mSilenceSuppression = false; ///< property: 'SilenceSuppression' Stop sending silent packets after the hangover, a silence descriptor is sent every keep-alive interval instead
+			float mSilenceThreshold = 0.0f; ///< property: 'SilenceThreshold' Peak amplitude at or below which a packet is silent, 0 only suppresses digital silence
+			float mSilenceHangover = 200.0f; ///< property: 'SilenceHangover' Milliseconds of silence that are still sent before suppression starts
+			float mKeepAliveInterval = 500.0f; ///< property: 'KeepAliveInterval' Milliseconds between silence descriptors while packets are suppressed
+			ResourcePtr<VBANLatencyMonitor> mLatencyMonitor = nullptr; ///< property: 'LatencyMonitor' Optional monitor that measures the latency of the stream, share it with the VBANStreamPlayerComponent playing the stream
 		};
 
         /**
@@ -85,9 +102,18 @@ namespace nap
              */
 			OutputPin* getOutputForChannel(int channel) override { return mInput->getOutputForChannel(channel); }
 
+            /**
+             * Copies the transmit counters, can be called from any thread
+             * @param statistics receives the counters
+             */
+            void getStatistics(VBANSenderStatistics& statistics) const;
+
 		private:
 			ComponentInstancePtr<audio::AudioComponentBase> mInput	= {this, &VBANStreamSenderComponent::mInput};
 			audio::SafeOwner<audio::VBANSenderNode> mVBANSenderNode = nullptr;
+			std::unique_ptr<VBANPacketSender> mSender = nullptr;    // Sends the packets when no transmitter is used
+			VBANUDPTransmitter* mTransmitter = nullptr;             // Sends the packets when the shared transmitter is used
+			std::shared_ptr<VBANPacketQueue> mQueue = nullptr;      // Queue the node pushes the packets to
 		};
 	}
 }
@@ -0,0 +1,458 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "vbanudpserver.h"
+#include "vbanutils.h"
+
+// Nap includes
+#include <nap/logger.h>
+
+// Std includes
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// Platform includes
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
+
+RTTI_BEGIN_CLASS(nap::VBANUDPServer)
+RTTI_PROPERTY("Port", &nap::VBANUDPServer::mPort, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("IP Address", &nap::VBANUDPServer::mIPAddress, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("BatchSize", &nap::VBANUDPServer::mBatchSize, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("ReceiveBufferSize", &nap::VBANUDPServer::mReceiveBufferSize, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("Shards", &nap::VBANUDPServer::mShards, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("Timestamps", &nap::VBANUDPServer::mTimestamps, nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+namespace nap
+{
+    // Size of a slot in the packet ring, VBAN packets are at most 1464 bytes
+    static constexpr size_t sMaxPacketSize = 2048;
+
+    // Max time the receive thread waits for data before checking if it has to stop
+    static constexpr int sPollTimeout = 100;
+
+
+    struct VBANUDPServer::Shard
+    {
+        int mIndex = 0;
+        std::thread mThread;
+        std::vector<nap::uint8> mPacketStorage;         // Preallocated storage for a full batch of packets
+        std::vector<VBANReceivedPacket> mPackets;       // Packets of the current batch
+
+#ifdef _WIN32
+        SOCKET mHandle = INVALID_SOCKET;
+        bool isOpen() const { return mHandle != INVALID_SOCKET; }
+#else
+        int mHandle = -1;
+        bool isOpen() const { return mHandle >= 0; }
+#endif
+
+#ifdef __linux__
+        std::vector<mmsghdr> mMessages;                 // One message header per slot in the packet ring
+        std::vector<iovec> mVectors;                    // Points each message to its slot
+        std::vector<nap::uint8> mControlStorage;        // Ancillary data of every message, holds the kernel time stamp
+#endif
+    };
+
+
+    // Current time on the steady clock in nanoseconds, the clock all packet times are expressed in
+    static int64_t getSteadyTime()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+
+#ifdef __linux__
+    // Space for the ancillary data of a single message
+    static constexpr size_t sControlSize = CMSG_SPACE(sizeof(timespec));
+
+
+    // Steers every packet to the socket of the shard of its stream, see utility::getVBANStreamShard().
+    // The filter runs on the UDP payload, packets too short to hold a stream name end up on the first shard.
+    static bool attachShardFilter(int handle, int shardCount)
+    {
+        uint32_t const name = offsetof(VBanHeader, streamname);
+        sock_filter code[] =
+        {
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, name),
+            BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, VBAN_STREAM_SHARD_MULTIPLIER),
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, name + 4),
+            BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+            BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, VBAN_STREAM_SHARD_MULTIPLIER),
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, name + 8),
+            BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+            BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, VBAN_STREAM_SHARD_MULTIPLIER),
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, name + 12),
+            BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+            BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, VBAN_STREAM_SHARD_MULTIPLIER),
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 15),
+            BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+            BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, VBAN_STREAM_SHARD_MULTIPLIER),
+            BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+            BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(shardCount)),
+            BPF_STMT(BPF_RET | BPF_A, 0)
+        };
+        sock_fprog program = { static_cast<unsigned short>(sizeof(code) / sizeof(code[0])), code };
+        return setsockopt(handle, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0;
+    }
+
+
+    // Returns the kernel receive time of a message on the real time clock in nanoseconds, 0 when absent
+    static int64_t getKernelTime(msghdr& message)
+    {
+        for (cmsghdr* control = CMSG_FIRSTHDR(&message); control != nullptr; control = CMSG_NXTHDR(&message, control))
+        {
+            if (control->cmsg_level != SOL_SOCKET || control->cmsg_type != SCM_TIMESTAMPNS)
+                continue;
+
+            timespec time;
+            std::memcpy(&time, CMSG_DATA(control), sizeof(time));
+            return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+        }
+        return 0;
+    }
+#endif
+
+
+    static bool isWouldBlock()
+    {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+    }
+
+
+    VBANUDPServer::VBANUDPServer()
+    {
+    }
+
+
+    VBANUDPServer::~VBANUDPServer()
+    {
+        if (mRunning)
+            stop();
+    }
+
+
+    int VBANUDPServer::getShardCount() const
+    {
+#ifdef __linux__
+        return std::max(mShards, 1);
+#else
+        return 1;
+#endif
+    }
+
+
+    bool VBANUDPServer::start(utility::ErrorState& errorState)
+    {
+        if (!errorState.check(mPort > 0 && mPort <= 65535, "%s: invalid port %i", mID.c_str(), mPort))
+            return false;
+
+        if (!errorState.check(mBatchSize > 0, "%s: BatchSize must be at least 1", mID.c_str()))
+            return false;
+
+        if (mShards > getShardCount())
+            nap::Logger::warn("%s: sharding is not supported on this platform, receiving on a single socket", mID.c_str());
+
+#ifndef __linux__
+        if (mTimestamps)
+            nap::Logger::warn("%s: kernel time stamps are not supported on this platform, using the time packets are read", mID.c_str());
+#endif
+
+#ifdef _WIN32
+        WSADATA wsa_data;
+        if (!errorState.check(WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0, "%s: failed to initialize winsock", mID.c_str()))
+            return false;
+#endif
+
+        // open all sockets before starting any thread, so a failing shard leaves nothing running
+        mShardList.clear();
+        bool opened = true;
+        for (int i = 0; i < getShardCount() && opened; i++)
+        {
+            auto shard = std::make_unique<Shard>();
+            shard->mIndex = i;
+            mShardList.emplace_back(std::move(shard));
+            opened = openShard(*mShardList.back(), errorState);
+        }
+
+#ifdef __linux__
+        // sockets join the port group in the order they are bound, so the filter result is the shard index
+        if (opened && getShardCount() > 1)
+        {
+            opened = errorState.check(attachShardFilter(mShardList.front()->mHandle, getShardCount()),
+                                      "%s: failed to attach the shard filter: %s", mID.c_str(), utility::getLastVBANSocketError().c_str());
+        }
+#endif
+
+        if (!opened)
+        {
+            for (auto& shard : mShardList)
+                closeShard(*shard);
+            mShardList.clear();
+#ifdef _WIN32
+            WSACleanup();
+#endif
+            return false;
+        }
+
+        mRunning = true;
+        for (auto& shard : mShardList)
+        {
+            Shard* receiver = shard.get();
+            shard->mThread = std::thread([this, receiver](){ receiveLoop(*receiver); });
+        }
+
+        return true;
+    }
+
+
+    void VBANUDPServer::stop()
+    {
+        mRunning = false;
+        for (auto& shard : mShardList)
+        {
+            if (shard->mThread.joinable())
+                shard->mThread.join();
+            closeShard(*shard);
+        }
+        mShardList.clear();
+
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+
+    void VBANUDPServer::registerListenerSlot(Slot<const VBANPacketBatch&>& slot)
+    {
+        std::unique_lock<std::shared_mutex> lock(mMutex);
+        mBatchReceived.connect(slot);
+    }
+
+
+    void VBANUDPServer::removeListenerSlot(Slot<const VBANPacketBatch&>& slot)
+    {
+        std::unique_lock<std::shared_mutex> lock(mMutex);
+        mBatchReceived.disconnect(slot);
+    }
+
+
+    bool VBANUDPServer::openShard(Shard& shard, utility::ErrorState& errorState)
+    {
+        // preallocate the packet ring, the receive thread never allocates
+        shard.mPacketStorage.assign(static_cast<size_t>(mBatchSize) * sMaxPacketSize, 0);
+        shard.mPackets.assign(static_cast<size_t>(mBatchSize), VBANReceivedPacket());
+
+#ifdef __linux__
+        shard.mMessages.assign(static_cast<size_t>(mBatchSize), mmsghdr());
+        shard.mVectors.resize(static_cast<size_t>(mBatchSize));
+        for (size_t i = 0; i < shard.mVectors.size(); i++)
+        {
+            shard.mVectors[i].iov_base = &shard.mPacketStorage[i * sMaxPacketSize];
+            shard.mVectors[i].iov_len = sMaxPacketSize;
+            shard.mMessages[i].msg_hdr.msg_iov = &shard.mVectors[i];
+            shard.mMessages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // reserve room for the kernel time stamp of every message
+        if (mTimestamps)
+        {
+            shard.mControlStorage.assign(static_cast<size_t>(mBatchSize) * sControlSize, 0);
+            for (size_t i = 0; i < shard.mMessages.size(); i++)
+                shard.mMessages[i].msg_hdr.msg_control = &shard.mControlStorage[i * sControlSize];
+        }
+#endif
+
+        // resolve the address to bind to
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(mPort));
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (!errorState.check(mIPAddress.empty() || inet_pton(AF_INET, mIPAddress.c_str(), &address.sin_addr) == 1,
+                              "%s: invalid IP address %s", mID.c_str(), mIPAddress.c_str()))
+            return false;
+
+        shard.mHandle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (!errorState.check(shard.isOpen(), "%s: failed to create socket: %s", mID.c_str(), utility::getLastVBANSocketError().c_str()))
+            return false;
+
+        if (mReceiveBufferSize > 0)
+        {
+            int const size = mReceiveBufferSize;
+            if (setsockopt(shard.mHandle, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&size), sizeof(size)) != 0)
+                nap::Logger::warn("%s: failed to set receive buffer size to %i bytes", mID.c_str(), size);
+        }
+
+#ifdef __linux__
+        // all sockets share the port, the shard filter picks the socket of every packet
+        if (getShardCount() > 1)
+        {
+            int const enable = 1;
+            if (!errorState.check(setsockopt(shard.mHandle, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == 0,
+                                  "%s: failed to enable port reuse: %s", mID.c_str(), utility::getLastVBANSocketError().c_str()))
+                return false;
+        }
+
+        if (mTimestamps)
+        {
+            int const enable = 1;
+            if (!errorState.check(setsockopt(shard.mHandle, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0,
+                                  "%s: failed to enable time stamps: %s", mID.c_str(), utility::getLastVBANSocketError().c_str()))
+                return false;
+        }
+#endif
+
+        if (!errorState.check(bind(shard.mHandle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0,
+                              "%s: failed to bind to port %i: %s", mID.c_str(), mPort, utility::getLastVBANSocketError().c_str()))
+            return false;
+
+        // the thread waits with poll, reading drains the socket without blocking
+#ifdef _WIN32
+        u_long non_blocking = 1;
+        bool const non_blocking_set = ioctlsocket(shard.mHandle, FIONBIO, &non_blocking) == 0;
+#else
+        bool const non_blocking_set = fcntl(shard.mHandle, F_SETFL, fcntl(shard.mHandle, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+        if (!errorState.check(non_blocking_set, "%s: failed to make socket non blocking: %s", mID.c_str(), utility::getLastVBANSocketError().c_str()))
+            return false;
+
+        return true;
+    }
+
+
+    void VBANUDPServer::closeShard(Shard& shard)
+    {
+#ifdef _WIN32
+        if (shard.isOpen())
+            closesocket(shard.mHandle);
+        shard.mHandle = INVALID_SOCKET;
+#else
+        if (shard.isOpen())
+            close(shard.mHandle);
+        shard.mHandle = -1;
+#endif
+    }
+
+
+    void VBANUDPServer::receiveLoop(Shard& shard)
+    {
+        while (mRunning)
+        {
+            // wait for data, wake up regularly to check if the server is stopped
+#ifdef _WIN32
+            WSAPOLLFD descriptor = { shard.mHandle, POLLRDNORM, 0 };
+            int const ready = WSAPoll(&descriptor, 1, sPollTimeout);
+#else
+            pollfd descriptor = { shard.mHandle, POLLIN, 0 };
+            int const ready = poll(&descriptor, 1, sPollTimeout);
+#endif
+            if (ready <= 0)
+                continue;
+
+            int const count = receiveBatch(shard);
+            if (count == 0)
+                continue;
+
+            VBANPacketBatch batch;
+            batch.mPackets = shard.mPackets.data();
+            batch.mCount = count;
+            batch.mShard = shard.mIndex;
+
+            // shards dispatch concurrently, only (un)registering listeners is exclusive
+            std::shared_lock<std::shared_mutex> lock(mMutex);
+            mBatchReceived.trigger(batch);
+        }
+    }
+
+
+    int VBANUDPServer::receiveBatch(Shard& shard)
+    {
+        int count = 0;
+
+#ifdef __linux__
+        // the kernel shrinks the control length to the ancillary data it wrote, restore the full space
+        if (mTimestamps)
+        {
+            for (auto& message : shard.mMessages)
+                message.msg_hdr.msg_controllen = sControlSize;
+        }
+
+        // pull everything that is waiting, up to a full batch, with a single system call
+        int const received = recvmmsg(shard.mHandle, shard.mMessages.data(), static_cast<unsigned int>(mBatchSize), MSG_DONTWAIT, nullptr);
+        if (received < 0)
+        {
+            if (!isWouldBlock())
+                nap::Logger::error("%s: receive failed: %s", mID.c_str(), utility::getLastVBANSocketError().c_str());
+            return 0;
+        }
+
+        // kernel time stamps are on the real time clock, move them to the steady clock packet times are expressed in
+        int64_t const receive_time = getSteadyTime();
+        int64_t clock_offset = 0;
+        if (mTimestamps)
+        {
+            timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            clock_offset = receive_time - (static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec);
+        }
+
+        for (; count < received; count++)
+        {
+            shard.mPackets[count].mData = &shard.mPacketStorage[count * sMaxPacketSize];
+            shard.mPackets[count].mSize = shard.mMessages[count].msg_len;
+            int64_t const kernel_time = mTimestamps ? getKernelTime(shard.mMessages[count].msg_hdr) : 0;
+            shard.mPackets[count].mReceiveTime = kernel_time != 0 ? kernel_time + clock_offset : receive_time;
+        }
+#else
+        // drain the non blocking socket one datagram at a time
+        while (count < mBatchSize)
+        {
+            nap::uint8* slot = &shard.mPacketStorage[count * sMaxPacketSize];
+            auto const received = recv(shard.mHandle, reinterpret_cast<char*>(slot), static_cast<int>(sMaxPacketSize), 0);
+            if (received < 0)
+            {
+                if (!isWouldBlock())
+                    nap::Logger::error("%s: receive failed: %s", mID.c_str(), utility::getLastVBANSocketError().c_str());
+                break;
+            }
+
+            shard.mPackets[count].mData = slot;
+            shard.mPackets[count].mSize = static_cast<size_t>(received);
+            shard.mPackets[count].mReceiveTime = getSteadyTime();
+            count++;
+        }
+#endif
+
+        return count;
+    }
+}
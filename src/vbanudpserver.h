@@ -0,0 +1,112 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Nap includes
+#include <nap/device.h>
+#include <nap/signalslot.h>
+
+// Std includes
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace nap
+{
+    /**
+     * A single datagram received by the VBANUDPServer
+     */
+    struct VBANReceivedPacket
+    {
+        const nap::uint8* mData = nullptr;  ///< Packet data, only valid for the duration of the batch callback
+        size_t mSize = 0;                   ///< Size of the packet in bytes
+        int64_t mReceiveTime = 0;           ///< Time the packet was received on the steady clock in nanoseconds, see VBANUDPServer::mTimestamps
+    };
+
+
+    /**
+     * A batch of datagrams pulled from the socket at once
+     */
+    struct VBANPacketBatch
+    {
+        const VBANReceivedPacket* mPackets = nullptr;   ///< The packets in order of arrival
+        int mCount = 0;                                 ///< Number of packets in the batch
+        int mShard = 0;                                 ///< Index of the shard that received the batch
+    };
+
+
+    /**
+     * Dedicated UDP receive backend for VBAN traffic, an alternative to the UDPServer for high packet rates.
+     * Runs its own thread that pulls all packets waiting on the socket in one go, using recvmmsg on Linux
+     * and a non blocking receive loop on other platforms, into a preallocated packet ring.
+     * The batch is handed to the listeners in a single call on the receive thread.
+     *
+     * With more than one shard, multiple sockets are bound to the same port using SO_REUSEPORT, each with its
+     * own receive thread. A socket filter (SO_ATTACH_REUSEPORT_CBPF) steers every packet to a shard by hashing its
+     * stream name, see utility::getVBANStreamShard(). All packets of a stream arrive in order on the same shard,
+     * no matter which sockets they are sent from, while the streams of a single sender are spread over all cores.
+     * The hash covers the complete 16 byte name field, the bytes after the name have to be zero as in all VBAN packets.
+     * Batches of different shards are handed to the listeners concurrently. Sharding is only available on Linux,
+     * other platforms always use a single shard.
+     */
+    class NAPAPI VBANUDPServer : public Device
+    {
+        RTTI_ENABLE(Device)
+    public:
+        VBANUDPServer();
+        ~VBANUDPServer() override;
+
+        /**
+         * Opens the socket and starts the receive thread
+         * @param errorState contains any errors
+         * @return true on success
+         */
+        bool start(utility::ErrorState& errorState) override;
+
+        /**
+         * Stops the receive thread and closes the socket
+         */
+        void stop() override;
+
+        /**
+         * Registers a slot that is called from the receive thread for every batch of packets
+         * @param slot the slot to register
+         */
+        void registerListenerSlot(Slot<const VBANPacketBatch&>& slot);
+
+        /**
+         * Removes a previously registered slot
+         * @param slot the slot to remove
+         */
+        void removeListenerSlot(Slot<const VBANPacketBatch&>& slot);
+
+        /**
+         * @return the number of shards batches are received on, batch shard indices are in the range [0, shard count)
+         */
+        int getShardCount() const;
+
+        int mPort = 13251;                  ///< Property: 'Port' the port to receive VBAN packets on
+        std::string mIPAddress = "";        ///< Property: 'IP Address' local address to bind to, leave empty to listen on all interfaces
+        int mBatchSize = 64;                ///< Property: 'BatchSize' max number of packets pulled from the socket at once
+        int mReceiveBufferSize = 0;         ///< Property: 'ReceiveBufferSize' size of the socket receive buffer in bytes, 0 keeps the OS default
+        int mShards = 1;                    ///< Property: 'Shards' number of sockets and receive threads sharing the port, streams are spread over them by name, Linux only
+        bool mTimestamps = false;           ///< Property: 'Timestamps' stamp packets with the time the kernel received them instead of the time they are read from the socket, Linux only
+
+    private:
+        struct Shard;
+        bool openShard(Shard& shard, utility::ErrorState& errorState);
+        void closeShard(Shard& shard);
+        void receiveLoop(Shard& shard);
+        int receiveBatch(Shard& shard);
+
+        Signal<const VBANPacketBatch&> mBatchReceived;
+        std::shared_mutex mMutex;                       // Guards the signal against (un)registering while batches are dispatched
+
+        std::atomic<bool> mRunning = { false };
+        std::vector<std::unique_ptr<Shard>> mShardList; // Socket, thread and packet ring of every shard
+    };
+}
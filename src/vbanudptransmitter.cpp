@@ -0,0 +1,389 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "vbanudptransmitter.h"
+#include "vbanutils.h"
+#include "vban/vban.h"
+
+// Nap includes
+#include <nap/logger.h>
+
+// Std includes
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// Platform includes
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
+
+RTTI_BEGIN_CLASS(nap::VBANUDPTransmitter)
+RTTI_PROPERTY("BatchSize", &nap::VBANUDPTransmitter::mBatchSize, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("SendBufferSize", &nap::VBANUDPTransmitter::mSendBufferSize, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("Segmentation", &nap::VBANUDPTransmitter::mSegmentation, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("MulticastTTL", &nap::VBANUDPTransmitter::mMulticastTTL, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("MulticastLoopback", &nap::VBANUDPTransmitter::mMulticastLoopback, nap::rtti::EPropertyMetaData::Default)
+RTTI_PROPERTY("MulticastInterface", &nap::VBANUDPTransmitter::mMulticastInterface, nap::rtti::EPropertyMetaData::Default)
+RTTI_END_CLASS
+
+namespace nap
+{
+    // Max time the transmit thread waits for packets before checking if it has to stop
+    static constexpr std::chrono::microseconds sWaitTimeout(100000);
+
+    // Limits of a single GSO send, the kernel accepts at most 64 segments and a 64 KB datagram
+    static constexpr int sMaxSegments = 64;
+    static constexpr size_t sMaxSegmentedSize = 65507;
+
+
+    struct VBANUDPTransmitter::Sender
+    {
+        std::shared_ptr<VBANPacketQueue> mQueue;
+        std::vector<sockaddr_in> mAddresses;    // Every packet is sent to all addresses
+    };
+
+
+    struct VBANUDPTransmitter::Socket
+    {
+        VBANSocketHandle mHandle = VBAN_INVALID_SOCKET;
+
+#ifdef __linux__
+        std::vector<mmsghdr> mMessages;                 // At most one message per datagram in a batch
+        std::vector<iovec> mVectors;                    // One vector per packet, a GSO message spans multiple vectors
+        std::vector<char> mControl;                     // Segment size control message of every message
+        std::vector<int> mMessagePackets;               // Index of the first packet of every message
+        std::vector<int> mMessageSegments;              // Number of packets in every message
+        std::vector<int> mMessageDestinations;          // Index of the sender address every message is sent to
+#endif
+    };
+
+
+    VBANUDPTransmitter::VBANUDPTransmitter()
+    {
+        mSignal = std::make_shared<VBANWakeSignal>();
+    }
+
+
+    VBANUDPTransmitter::~VBANUDPTransmitter()
+    {
+        if (mRunning)
+            stop();
+    }
+
+
+    bool VBANUDPTransmitter::start(utility::ErrorState& errorState)
+    {
+        if (!errorState.check(mBatchSize > 0, "%s: BatchSize must be at least 1", mID.c_str()))
+            return false;
+
+#ifdef __linux__
+        mUseSegmentation = mSegmentation;
+#else
+        if (mSegmentation)
+            nap::Logger::warn("%s: segmentation is not supported on this platform, sending datagrams separately", mID.c_str());
+        mUseSegmentation = false;
+#endif
+
+        // preallocate everything the transmit thread needs for a full batch
+        mSocket = std::make_unique<Socket>();
+        mPackets.assign(static_cast<size_t>(mBatchSize), VBANQueuedPacket());
+        mPacketSenders.assign(static_cast<size_t>(mBatchSize), nullptr);
+#ifdef __linux__
+        mSocket->mMessages.assign(static_cast<size_t>(mBatchSize), mmsghdr());
+        mSocket->mVectors.assign(static_cast<size_t>(mBatchSize), iovec());
+        mSocket->mControl.assign(static_cast<size_t>(mBatchSize) * CMSG_SPACE(sizeof(uint16_t)), 0);
+        mSocket->mMessagePackets.assign(static_cast<size_t>(mBatchSize) + 1, 0);
+        mSocket->mMessageSegments.assign(static_cast<size_t>(mBatchSize), 0);
+        mSocket->mMessageDestinations.assign(static_cast<size_t>(mBatchSize), 0);
+#endif
+
+        if (!utility::openVBANSendSocket(mSocket->mHandle, mID, errorState))
+        {
+            mSocket = nullptr;
+            return false;
+        }
+
+        if (mSendBufferSize > 0)
+        {
+            int const size = mSendBufferSize;
+            if (setsockopt(mSocket->mHandle, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&size), sizeof(size)) != 0)
+                nap::Logger::warn("%s: failed to set send buffer size to %i bytes", mID.c_str(), size);
+        }
+
+        // only used for multicast destinations
+        int const ttl = mMulticastTTL;
+        if (setsockopt(mSocket->mHandle, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&ttl), sizeof(ttl)) != 0)
+            nap::Logger::warn("%s: failed to set multicast TTL to %i", mID.c_str(), ttl);
+
+        int const loopback = mMulticastLoopback ? 1 : 0;
+        if (setsockopt(mSocket->mHandle, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char*>(&loopback), sizeof(loopback)) != 0)
+            nap::Logger::warn("%s: failed to set multicast loopback", mID.c_str());
+
+        if (!mMulticastInterface.empty())
+        {
+            in_addr interface_address = {};
+            bool const interface_set = inet_pton(AF_INET, mMulticastInterface.c_str(), &interface_address) == 1 &&
+                setsockopt(mSocket->mHandle, IPPROTO_IP, IP_MULTICAST_IF, reinterpret_cast<const char*>(&interface_address), sizeof(interface_address)) == 0;
+            if (!errorState.check(interface_set, "%s: invalid multicast interface %s", mID.c_str(), mMulticastInterface.c_str()))
+            {
+                stop();
+                return false;
+            }
+        }
+
+        mRunning = true;
+        mThread = std::thread([this](){ transmitLoop(); });
+        return true;
+    }
+
+
+    void VBANUDPTransmitter::stop()
+    {
+        mRunning = false;
+        mSignal->wake();
+        if (mThread.joinable())
+            mThread.join();
+
+        if (mSocket != nullptr)
+        {
+            utility::closeVBANSocket(mSocket->mHandle);
+            mSocket = nullptr;
+        }
+    }
+
+
+    std::shared_ptr<VBANPacketQueue> VBANUDPTransmitter::addSender(const std::vector<std::string>& endpoints, int port, int queueSize, utility::ErrorState& errorState)
+    {
+        if (!errorState.check(static_cast<int>(endpoints.size()) <= mBatchSize, "%s: %i endpoints exceed the BatchSize of %i",
+                              mID.c_str(), static_cast<int>(endpoints.size()), mBatchSize))
+            return nullptr;
+
+        if (!errorState.check(queueSize > 0, "%s: queue size must be at least 1", mID.c_str()))
+            return nullptr;
+
+        auto sender = std::make_unique<Sender>();
+        if (!utility::getVBANEndpointAddresses(endpoints, port, sender->mAddresses, mID, errorState))
+            return nullptr;
+
+        // all queues wake up the same thread
+        sender->mQueue = std::make_shared<VBANPacketQueue>();
+        sender->mQueue->init(queueSize, VBAN_PROTOCOL_MAX_SIZE, std::max(mBatchSize, 1), mSignal);
+        auto queue = sender->mQueue;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSenders.emplace_back(std::move(sender));
+        return queue;
+    }
+
+
+    void VBANUDPTransmitter::removeSender(const VBANPacketQueue* queue)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSenders.erase(std::remove_if(mSenders.begin(), mSenders.end(), [queue](const auto& sender)
+        {
+            return sender->mQueue.get() == queue;
+        }), mSenders.end());
+    }
+
+
+    void VBANUDPTransmitter::transmitLoop()
+    {
+        while (mRunning)
+        {
+            // a full batch means more packets may be waiting, otherwise sleep until the next paced packet is due
+            int64_t next_due_time;
+            if (flush(next_due_time))
+                continue;
+
+            auto timeout = sWaitTimeout;
+            if (next_due_time != std::numeric_limits<int64_t>::max())
+                timeout = std::min(timeout, std::chrono::microseconds(std::max<int64_t>(next_due_time - VBANPacketQueue::getClockTime(), 0) / 1000));
+            mSignal->wait(timeout);
+        }
+    }
+
+
+    bool VBANUDPTransmitter::flush(int64_t& nextDueTime)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        int64_t const now = VBANPacketQueue::getClockTime();
+        nextDueTime = std::numeric_limits<int64_t>::max();
+
+        // collect the packets of all senders, starting at another sender every time so a full batch does not starve the last ones.
+        // A packet becomes a datagram per endpoint of its sender, the batch is full when it holds BatchSize datagrams
+        int count = 0;
+        int datagrams = 0;
+        bool full = false;
+        size_t const sender_count = mSenders.size();
+        for (size_t i = 0; i < sender_count; i++)
+        {
+            Sender* sender = mSenders[(mFirstSender + i) % sender_count].get();
+            int const endpoints = static_cast<int>(sender->mAddresses.size());
+            int const room = (mBatchSize - datagrams) / endpoints;
+            int const taken = room > 0 ? sender->mQueue->pop(&mPackets[count], room, now) : 0;
+            std::fill(mPacketSenders.begin() + count, mPacketSenders.begin() + count + taken, sender);
+            count += taken;
+            datagrams += taken * endpoints;
+            full |= taken == room;
+
+            // the packets left in the queue are not due yet, or did not fit the batch
+            int64_t due_time;
+            if (sender->mQueue->getNextDueTime(due_time))
+                nextDueTime = std::min(nextDueTime, due_time);
+        }
+        mFirstSender = sender_count > 0 ? (mFirstSender + 1) % sender_count : 0;
+        if (count == 0)
+            return false;
+
+#ifdef __linux__
+        // hand all packets to the kernel at once, sendmmsg may send less than requested
+        int first = 0;
+        int resume_end = 0;
+        int resume_destination = 0;
+        while (first < count)
+        {
+            int const messages = buildMessages(first, count, resume_end, resume_destination);
+            int sent = 0;
+            while (sent < messages)
+            {
+                int const result = sendmmsg(mSocket->mHandle, &mSocket->mMessages[sent], static_cast<unsigned int>(messages - sent), 0);
+                mSendCalls.add();
+                if (result > 0)
+                {
+                    for (int message = sent; message < sent + result; message++)
+                        mPacketsSent.add(mSocket->mMessageSegments[message]);
+                    sent += result;
+                    continue;
+                }
+                if (result < 0 && errno == EINTR)
+                    continue;
+
+                // the kernel or device does not support GSO, send the rest of the batch without it
+                int const message_packets = mSocket->mMessageSegments[sent];
+                if (mUseSegmentation && message_packets > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP))
+                {
+                    nap::Logger::warn("%s: segmentation offload not supported, sending datagrams separately: %s", mID.c_str(), utility::getLastVBANSocketError().c_str());
+                    mUseSegmentation = false;
+                    resume_end = mSocket->mMessagePackets[sent] + message_packets;
+                    resume_destination = mSocket->mMessageDestinations[sent];
+                    break;
+                }
+
+                // skip the refused message
+                mSendErrors.add(message_packets);
+                sent++;
+            }
+            first = mSocket->mMessagePackets[sent];
+        }
+#else
+        for (int i = 0; i < count; i++)
+        {
+            for (const auto& address : mPacketSenders[i]->mAddresses)
+            {
+                auto const result = sendto(mSocket->mHandle, reinterpret_cast<const char*>(mPackets[i].mData), static_cast<int>(mPackets[i].mSize), 0,
+                                           reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+                mSendCalls.add();
+                if (result < 0)
+                    mSendErrors.add();
+                else
+                    mPacketsSent.add();
+            }
+        }
+#endif
+
+        // return the buffers to the queues, the packets of a sender are consecutive
+        int run_start = 0;
+        for (int i = 1; i <= count; i++)
+        {
+            if (i == count || mPacketSenders[i] != mPacketSenders[run_start])
+            {
+                mPacketSenders[run_start]->mQueue->release(&mPackets[run_start], i - run_start);
+                run_start = i;
+            }
+        }
+        return full;
+    }
+
+
+    int VBANUDPTransmitter::buildMessages(int first, int count, int resumeEnd, int resumeDestination)
+    {
+#ifdef __linux__
+        int messages = 0;
+        int packet = first;
+        while (packet < count)
+        {
+            Sender* sender = mPacketSenders[packet];
+            size_t const size = mPackets[packet].mSize;
+
+            // with GSO, consecutive packets of a sender with the same size become segments of one send
+            int segments = 1;
+            if (mUseSegmentation)
+            {
+                int const max_segments = std::min(sMaxSegments, static_cast<int>(sMaxSegmentedSize / std::max<size_t>(size, 1)));
+                while (packet + segments < count && segments < max_segments &&
+                       mPacketSenders[packet + segments] == sender && mPackets[packet + segments].mSize == size)
+                    segments++;
+            }
+
+            for (int i = packet; i < packet + segments; i++)
+            {
+                mSocket->mVectors[i].iov_base = const_cast<nap::uint8*>(mPackets[i].mData);
+                mSocket->mVectors[i].iov_len = mPackets[i].mSize;
+            }
+
+            // every destination gets a message pointing at the same vectors, packets already sent
+            // to the first destinations before falling back from GSO skip those
+            int const destination_count = static_cast<int>(sender->mAddresses.size());
+            for (int destination = packet < resumeEnd ? resumeDestination : 0; destination < destination_count; destination++)
+            {
+                sockaddr_in& address = sender->mAddresses[destination];
+                msghdr& header = mSocket->mMessages[messages].msg_hdr;
+                header = msghdr();
+                header.msg_name = &address;
+                header.msg_namelen = sizeof(address);
+                header.msg_iov = &mSocket->mVectors[packet];
+                header.msg_iovlen = static_cast<size_t>(segments);
+                if (segments > 1)
+                {
+                    char* control = &mSocket->mControl[messages * CMSG_SPACE(sizeof(uint16_t))];
+                    header.msg_control = control;
+                    header.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+                    cmsghdr* message = CMSG_FIRSTHDR(&header);
+                    message->cmsg_level = IPPROTO_UDP;
+                    message->cmsg_type = UDP_SEGMENT;
+                    message->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                    uint16_t const segment_size = static_cast<uint16_t>(size);
+                    std::memcpy(CMSG_DATA(message), &segment_size, sizeof(segment_size));
+                }
+
+                mSocket->mMessagePackets[messages] = packet;
+                mSocket->mMessageSegments[messages] = segments;
+                mSocket->mMessageDestinations[messages] = destination;
+                messages++;
+            }
+            packet += segments;
+        }
+        mSocket->mMessagePackets[messages] = count;
+        return messages;
+#else
+        return 0;
+#endif
+    }
+}
@@ -0,0 +1,117 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+// Nap includes
+#include <nap/device.h>
+
+// Vban includes
+#include "vbanpacketqueue.h"
+#include "vbanstatistics.h"
+
+// Std includes
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nap
+{
+    /**
+     * Dedicated UDP transmit backend for VBAN traffic, shared by all VBANStreamSenderComponents that point to it.
+     * Every sender gets its own packet queue, the audio thread pushes the packets of a block and wakes up the transmit
+     * thread once. The transmit thread then takes the packets of all senders out of their queues and hands them to
+     * the kernel with a single sendmmsg call on Linux, or one send per packet on other platforms.
+     * Optionally equal sized packets of a sender are coalesced into one UDP GSO send, the kernel splits them into datagrams.
+     * GSO is disabled automatically when the kernel or network device does not support it.
+     * A sender can have multiple endpoints, unicast addresses and multicast groups mixed: every packet is encoded once
+     * and the same buffer is referenced by one message per endpoint in the same sendmmsg call, nothing is copied.
+     * Paced packets are held back in their queue until they are due, the thread sleeps until the next packet is due.
+     */
+    class NAPAPI VBANUDPTransmitter : public Device
+    {
+        RTTI_ENABLE(Device)
+    public:
+        VBANUDPTransmitter();
+        ~VBANUDPTransmitter() override;
+
+        /**
+         * Opens the socket and starts the transmit thread
+         * @param errorState contains any errors
+         * @return true on success
+         */
+        bool start(utility::ErrorState& errorState) override;
+
+        /**
+         * Stops the transmit thread and closes the socket, queued packets are not sent
+         */
+        void stop() override;
+
+        /**
+         * Creates the queue of a new sender, call from the main thread.
+         * @param endpoints IPv4 unicast or multicast addresses the packets of the sender are sent to, as 'address' or 'address:port'
+         * @param port port of the endpoints that don't specify one
+         * @param queueSize max number of packets waiting to be sent, the oldest are dropped when the network falls behind
+         * @param errorState contains any errors
+         * @return the queue the sender pushes its packets to, nullptr on failure
+         */
+        std::shared_ptr<VBANPacketQueue> addSender(const std::vector<std::string>& endpoints, int port, int queueSize, utility::ErrorState& errorState);
+
+        /**
+         * Removes a sender, call from the main thread. Waits for a send that is in progress, the queue is not used anymore after this returns.
+         * @param queue the queue returned by addSender()
+         */
+        void removeSender(const VBANPacketQueue* queue);
+
+        /**
+         * @return number of datagrams handed to the kernel, can be called from any thread
+         */
+        uint64_t getPacketCount() const { return mPacketsSent.get(); }
+
+        /**
+         * @return number of send system calls, can be called from any thread
+         */
+        uint64_t getSendCallCount() const { return mSendCalls.get(); }
+
+        /**
+         * @return number of datagrams the kernel refused, can be called from any thread
+         */
+        uint64_t getErrorCount() const { return mSendErrors.get(); }
+
+        int mBatchSize = 64;                ///< Property: 'BatchSize' max number of datagrams handed to the kernel at once, a packet sent to multiple endpoints counts once per endpoint
+        int mSendBufferSize = 0;            ///< Property: 'SendBufferSize' size of the socket send buffer in bytes, 0 keeps the OS default
+        bool mSegmentation = false;         ///< Property: 'Segmentation' coalesce equal sized packets of a sender into a single UDP GSO send, Linux only
+        int mMulticastTTL = 1;              ///< Property: 'MulticastTTL' number of router hops multicast packets survive, 1 keeps them on the local network
+        bool mMulticastLoopback = true;     ///< Property: 'MulticastLoopback' deliver multicast packets to receivers on this machine as well
+        std::string mMulticastInterface;    ///< Property: 'MulticastInterface' IPv4 address of the interface multicast packets are sent from, empty uses the default route
+
+    private:
+        struct Sender;
+        struct Socket;
+        void transmitLoop();
+        bool flush(int64_t& nextDueTime);
+        int buildMessages(int first, int count, int resumeEnd, int resumeDestination);
+
+        std::unique_ptr<Socket> mSocket;                // Socket and preallocated message headers
+        std::vector<std::unique_ptr<Sender>> mSenders;  // Queue and destinations of every sender
+        std::mutex mMutex;                              // Guards the senders against (un)registering while packets are sent
+        std::shared_ptr<VBANWakeSignal> mSignal;        // Shared by the queues of all senders
+
+        // Packets taken out of the queues by the transmit thread and the sender each packet belongs to
+        std::vector<VBANQueuedPacket> mPackets;
+        std::vector<Sender*> mPacketSenders;
+        size_t mFirstSender = 0;                        // Sender whose queue is emptied first in the next flush
+
+        std::atomic<bool> mRunning = { false };
+        std::thread mThread;
+        bool mUseSegmentation = false;                  // Cleared when the kernel refuses GSO
+
+        VBANCounter mPacketsSent;
+        VBANCounter mSendCalls;
+        VBANCounter mSendErrors;
+    };
+}
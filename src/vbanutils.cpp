@@ -1,5 +1,22 @@
 #include "vbanutils.h"
 
+// Std includes
+#include <cstdlib>
+#include <cstring>
+
+// Platform includes
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 namespace nap
 {
     bool utility::getVBANSampleRateFormatFromSampleRate(uint8_t& srFormat, int sampleRate, utility::ErrorState& errorState)
@@ -29,4 +46,119 @@ namespace nap
         errorState.fail("Could not find samplerate for VBAN sample rate format %i", srFormat);
         return false;
     }
-}
\ No newline at end of file
+
+
+    VBANStreamKey utility::makeVBANStreamKey(const char* name, size_t length)
+    {
+        // copy characters up to the first NUL, remaining bytes stay zero
+        char bytes[VBAN_STREAM_NAME_SIZE] = { 0 };
+        size_t const max_length = length < VBAN_STREAM_NAME_SIZE ? length : VBAN_STREAM_NAME_SIZE;
+        for (size_t i = 0; i < max_length && name[i] != 0; i++)
+            bytes[i] = name[i];
+
+        VBANStreamKey key;
+        std::memcpy(key.mWords, bytes, VBAN_STREAM_NAME_SIZE);
+        return key;
+    }
+
+
+    VBANStreamKey utility::makeVBANStreamKey(const std::string& name)
+    {
+        return makeVBANStreamKey(name.c_str(), name.size());
+    }
+
+
+    int utility::getVBANStreamShard(const VBANStreamKey& key, int shardCount)
+    {
+        if (shardCount <= 1)
+            return 0;
+
+        // h = (h ^ word) * multiplier over the big endian words, the kernel filter loads the words in network order.
+        // Only operations classic BPF offers are used
+        uint8_t bytes[VBAN_STREAM_NAME_SIZE];
+        std::memcpy(bytes, key.mWords, VBAN_STREAM_NAME_SIZE);
+        uint32_t hash = 0;
+        for (size_t i = 0; i < VBAN_STREAM_NAME_SIZE; i += 4)
+        {
+            uint32_t const word = (static_cast<uint32_t>(bytes[i]) << 24) | (static_cast<uint32_t>(bytes[i + 1]) << 16) |
+                                  (static_cast<uint32_t>(bytes[i + 2]) << 8) | static_cast<uint32_t>(bytes[i + 3]);
+            hash = (hash ^ word) * VBAN_STREAM_SHARD_MULTIPLIER;
+        }
+
+        // mix the high bits down once more, names often only differ in their last characters
+        hash = (hash ^ (hash >> 15)) * VBAN_STREAM_SHARD_MULTIPLIER;
+        return static_cast<int>((hash >> 16) % static_cast<uint32_t>(shardCount));
+    }
+
+
+    bool utility::openVBANSendSocket(VBANSocketHandle& handle, const std::string& id, utility::ErrorState& errorState)
+    {
+#ifdef _WIN32
+        WSADATA wsa_data;
+        if (!errorState.check(WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0, "%s: failed to initialize winsock", id.c_str()))
+            return false;
+#endif
+
+        handle = static_cast<VBANSocketHandle>(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+        if (!errorState.check(handle != VBAN_INVALID_SOCKET, "%s: failed to create socket: %s", id.c_str(), getLastVBANSocketError().c_str()))
+        {
+#ifdef _WIN32
+            WSACleanup();
+#endif
+            return false;
+        }
+        return true;
+    }
+
+
+    void utility::closeVBANSocket(VBANSocketHandle& handle)
+    {
+        if (handle == VBAN_INVALID_SOCKET)
+            return;
+#ifdef _WIN32
+        closesocket(handle);
+        WSACleanup();
+#else
+        close(handle);
+#endif
+        handle = VBAN_INVALID_SOCKET;
+    }
+
+
+    std::string utility::getLastVBANSocketError()
+    {
+#ifdef _WIN32
+        return "error " + std::to_string(WSAGetLastError());
+#else
+        return strerror(errno);
+#endif
+    }
+
+
+    bool utility::getVBANEndpointAddresses(const std::vector<std::string>& endpoints, int port, std::vector<sockaddr_in>& addresses,
+                                           const std::string& id, utility::ErrorState& errorState)
+    {
+        if (!errorState.check(!endpoints.empty(), "%s: no endpoints to send to", id.c_str()))
+            return false;
+
+        // every endpoint is an address, optionally followed by a port
+        addresses.clear();
+        for (const auto& endpoint : endpoints)
+        {
+            auto const separator = endpoint.find(':');
+            std::string const address = endpoint.substr(0, separator);
+            int const endpoint_port = separator == std::string::npos ? port : std::atoi(endpoint.c_str() + separator + 1);
+            if (!errorState.check(endpoint_port > 0 && endpoint_port <= 65535, "%s: invalid port in endpoint %s", id.c_str(), endpoint.c_str()))
+                return false;
+
+            sockaddr_in destination = {};
+            destination.sin_family = AF_INET;
+            destination.sin_port = htons(static_cast<uint16_t>(endpoint_port));
+            if (!errorState.check(inet_pton(AF_INET, address.c_str(), &destination.sin_addr) == 1,
+                                  "%s: invalid IP address %s", id.c_str(), address.c_str()))
+                return false;
+            addresses.emplace_back(destination);
+        }
+        return true;
+    }
+}
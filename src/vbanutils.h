@@ -3,10 +3,104 @@
 #include <utility/errorstate.h>
 #include "vban/vban.h"
 
+// Std includes
+#include <string>
+#include <vector>
+
+// Platform socket address, defined by the platform socket headers
+struct sockaddr_in;
+
 namespace nap
 {
+    /**
+     * Native handle of a socket opened by utility::openVBANSendSocket(), a SOCKET on Windows and a file descriptor elsewhere
+     */
+#ifdef _WIN32
+    using VBANSocketHandle = uintptr_t;
+#else
+    using VBANSocketHandle = int;
+#endif
+
+    /**
+     * Handle of a socket that is not open, INVALID_SOCKET on Windows
+     */
+    constexpr VBANSocketHandle VBAN_INVALID_SOCKET = static_cast<VBANSocketHandle>(-1);
+
+    /**
+     * First payload byte of a silence descriptor: a VBAN_CODEC_USER packet without samples, sent instead of the
+     * silent packets of a stream with silence suppression enabled, see audio::VBANSenderNode::setSilenceSuppression().
+     * The header describes the format of the suppressed packets, the frame counter continues the sequence of the stream.
+     */
+    constexpr uint8_t VBAN_SILENCE_DESCRIPTOR_TAG = 0x53;
+
+    /**
+     * Size of a silence descriptor in bytes, the header followed by the tag
+     */
+    constexpr size_t VBAN_SILENCE_DESCRIPTOR_SIZE = VBAN_HEADER_SIZE + 1;
+
+
+    /**
+     * Multiplier of the stream name hash that steers streams to the shards of a VBANUDPServer, see utility::getVBANStreamShard()
+     */
+    constexpr uint32_t VBAN_STREAM_SHARD_MULTIPLIER = 0x9E3779B1u;
+
+
+    /**
+     * Fixed size key identifying a VBAN stream by its 16 byte stream name.
+     * All bytes following the name are zero, so two keys can be compared with two 64 bit compares.
+     * A name that fills the complete field does not need to be NUL terminated.
+     */
+    struct VBANStreamKey
+    {
+        uint64_t mWords[2] = { 0, 0 };
+
+        bool operator==(const VBANStreamKey& other) const { return mWords[0] == other.mWords[0] && mWords[1] == other.mWords[1]; }
+        bool operator!=(const VBANStreamKey& other) const { return !(*this == other); }
+    };
+
+
+    /**
+     * Hash function for VBANStreamKey, allows the key to be used in unordered containers
+     */
+    struct VBANStreamKeyHash
+    {
+        size_t operator()(const VBANStreamKey& key) const
+        {
+            uint64_t hash = key.mWords[0] * 0x9E3779B97F4A7C15ull;
+            hash ^= key.mWords[1] + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+            return static_cast<size_t>(hash);
+        }
+    };
+
+
     namespace utility
     {
+        /**
+         * Creates a stream key from a VBAN stream name field.
+         * Reads at most VBAN_STREAM_NAME_SIZE characters and stops at the first NUL character.
+         * @param name pointer to the stream name characters
+         * @param length max number of characters to read
+         * @return the stream key
+         */
+        VBANStreamKey makeVBANStreamKey(const char* name, size_t length = VBAN_STREAM_NAME_SIZE);
+
+        /**
+         * Creates a stream key from a stream name, names longer than VBAN_STREAM_NAME_SIZE are truncated
+         * @param name the stream name
+         * @return the stream key
+         */
+        VBANStreamKey makeVBANStreamKey(const std::string& name);
+
+        /**
+         * Returns the shard of a sharded VBANUDPServer the packets of a stream are received on.
+         * The stream name field is hashed as 4 big endian words, the same hash the socket filter of the server
+         * computes in the kernel, see VBANUDPServer::mShards.
+         * @param key the stream key
+         * @param shardCount number of shards
+         * @return shard index in the range [0, shardCount)
+         */
+        int getVBANStreamShard(const VBANStreamKey& key, int shardCount);
+
         /**
          * Translates given samplerate to VBAN sample rate format, returns true on success
          * @param srFormat reference to sample rate format
@@ -24,6 +118,39 @@ namespace nap
          * @return true on success
          */
         bool getSampleRateFromVBANSampleRateFormat(int& sampleRate, uint8_t srFormat, utility::ErrorState& errorState);
+
+        /**
+         * Opens an IPv4 UDP socket to send VBAN packets from, initializes winsock on Windows.
+         * Every successfully opened socket has to be closed with closeVBANSocket().
+         * @param handle receives the socket
+         * @param id identifies the owner of the socket in error messages
+         * @param errorState contains any errors
+         * @return true on success
+         */
+        bool openVBANSendSocket(VBANSocketHandle& handle, const std::string& id, utility::ErrorState& errorState);
+
+        /**
+         * Closes a socket opened by openVBANSendSocket() and releases winsock on Windows
+         * @param handle the socket, VBAN_INVALID_SOCKET afterwards
+         */
+        void closeVBANSocket(VBANSocketHandle& handle);
+
+        /**
+         * @return description of the error of the last failed socket call on the calling thread
+         */
+        std::string getLastVBANSocketError();
+
+        /**
+         * Resolves IPv4 endpoints given as 'address' or 'address:port'
+         * @param endpoints unicast, multicast or broadcast addresses, optionally followed by a port
+         * @param port port of the endpoints that don't specify one
+         * @param addresses receives one address per endpoint
+         * @param id identifies the owner of the endpoints in error messages
+         * @param errorState contains any errors
+         * @return true when all endpoints are valid
+         */
+        bool getVBANEndpointAddresses(const std::vector<std::string>& endpoints, int port, std::vector<sockaddr_in>& addresses,
+                                      const std::string& id, utility::ErrorState& errorState);
     }
 }
 